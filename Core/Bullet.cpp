@@ -1,20 +1,76 @@
 #include "Bullet.h"
 #include <algorithm>
 #include "Server.h"
-#include "Client.h"
+#include "Message.h"
+#include "Loader.h"
+#include "Skeleton.h"
 
 std::map<std::string, Bullet> globalBullets;
+static std::vector<Bullet*> bulletTable;
+
+namespace {
+    //a volley creates and destroys dozens of nodes a tick,so they are cloned once and reused.
+    //the server simulates on its own thread,so every thread has its own pools.
+    struct NodePools final {
+        std::vector<std::vector<uniqueRAII<Node>>> models, skeletons, booms;
+    };
+    thread_local NodePools pools;
+
+    Node* acquire(std::vector<std::vector<uniqueRAII<Node>>>& pool, uint16_t kind) {
+        if (pool.size() <= kind || pool[kind].empty())return nullptr;
+        auto node = pool[kind].back().release();
+        pool[kind].pop_back();
+        return node;
+    }
+
+    //the pool holds its own reference,the owner releases its one as before.
+    void recycle(std::vector<std::vector<uniqueRAII<Node>>>& pool, uint16_t kind, Node* node) {
+        if (node->getScene())
+            node->getScene()->removeNode(node);
+        else if (node->getParent())
+            node->getParent()->removeChild(node);
+#ifndef TFL_HEADLESS
+        std::function<void(Node*)> reset = [&](Node* n) {
+            auto p = dynamic_cast<ParticleEmitter*>(n->getDrawable());
+            if (p)p->reset();
+            for (auto i = n->getFirstChild(); i; i = i->getNextSibling())
+                reset(i);
+        };
+        reset(node);
+#endif // !TFL_HEADLESS
+        node->addRef();
+        if (pool.size() <= kind)
+            pool.resize(kind + 1);
+        pool[kind].emplace_back(node);
+    }
+}
+
+void clearBulletPools() {
+    pools = {};
+}
+
 void loadAllBullets() {
+    clearBulletPools();
     std::vector<std::string> paths;
     listDirs("/res/bullets", paths);
+    for (auto&& p : paths)
+        resourceLoader.prefetch("res/bullets/" + p + "/bullet.info");
     for (auto p : paths)
         globalBullets[p] = p;
+    bulletTable.clear();
+    for (auto&& b : globalBullets) {
+        b.second.mID = static_cast<uint16_t>(bulletTable.size());
+        bulletTable.emplace_back(&b.second);
+    }
 }
 
 Bullet & getBullet(uint16_t id) {
-    auto i = globalBullets.begin();
-    std::advance(i, id);
-    return i->second;
+    return *bulletTable[id];
+}
+
+uint16_t getBulletID(const std::string & name) {
+    auto i = globalBullets.find(name);
+    return i == globalBullets.cend() ? static_cast<uint16_t>(globalBullets.size()) : i->second.getID();
 }
 
 void Bullet::operator=(const std::string & name) {
@@ -24,17 +80,32 @@ void Bullet::operator=(const std::string & name) {
     mModelPath = full + "model.scene";
     mHitRadius = info->getFloat("radius");
     mBoomTime = info->getFloat("time");
-    uniqueRAII<ParticleEmitter> p = ParticleEmitter::create((full + "bullet.info#boom").c_str());
     mDuang = Node::create();
+#ifndef TFL_HEADLESS
+    uniqueRAII<ParticleEmitter> p = ParticleEmitter::create((full + "bullet.info#boom").c_str());
     mDuang->setDrawable(p.get());
+#endif // !TFL_HEADLESS
+}
+
+Node* Bullet::getModel(bool isServer) const {
+    auto&& proto = isServer ? mSkeleton : mModel;
+    if (!proto) {
+#ifdef TFL_HEADLESS
+        uniqueRAII<Scene> scene = loadSkeleton(mModelPath);
+#else
+        uniqueRAII<Scene> scene = isServer ? loadSkeleton(mModelPath) : Scene::load(mModelPath.c_str());
+#endif // TFL_HEADLESS
+        proto = scene->findNode("root")->clone();
+    }
+    auto node = acquire(isServer ? pools.skeletons : pools.models, mID);
+    return node ? node : proto->clone();
 }
 
-Node* Bullet::getModel() const {
-    if (!mModel) {
-        uniqueRAII<Scene> scene = Scene::load(mModelPath.c_str());
-        mModel = scene->findNode("root")->clone();
-    }
-    return mModel->clone();
+void Bullet::release(Node* model, bool isServer) const {
+    //the instance only moves the root,the children are as they were cloned.
+    auto&& proto = isServer ? mSkeleton : mModel;
+    model->set(proto->getScale(), proto->getRotation(), proto->getTranslation());
+    recycle(isServer ? pools.skeletons : pools.models, mID, model);
 }
 
 float Bullet::getRadius() const {
@@ -42,35 +113,47 @@ float Bullet::getRadius() const {
 }
 
 Node * Bullet::boom() {
-    return mDuang->clone();
+    auto node = acquire(pools.booms, mID);
+    return node ? node : mDuang->clone();
+}
+
+void Bullet::releaseBoom(Node* emitter) {
+    recycle(pools.booms, mID, emitter);
 }
 
 float Bullet::getBoomTime() const {
     return mBoomTime;
 }
 
+uint16_t Bullet::getID() const {
+    return mID;
+}
+
 uint32_t BulletInstance::cnt = 0;
 
 uint32_t BulletInstance::askID() {
     return ++cnt;
 }
 
+void BulletInstance::resetID() {
+    cnt = 0;
+}
+
 BulletInstance::BulletInstance(const std::string & kind, Vector3 begin, Vector3 end,Vector3 forward,
     float speed, float harm, float radius, uint8_t group, uint32_t obj, float angle)
-    :BulletInstance(std::distance(globalBullets.begin(), globalBullets.find(kind)),
-        begin, end, speed, harm, radius, group, obj, angle) {
+    :BulletInstance(getBulletID(kind),
+        begin, end, speed, harm, radius, group, true, obj, angle) {
     correctVector(mNode.get(), &Node::getForwardVector, forward, M_PI, M_PI, 0.0f);
 }
 
 BulletInstance::BulletInstance(uint16_t kind, Vector3 begin, Vector3 end,
-    float speed, float harm, float radius, uint8_t group, uint32_t object, float angle)
+    float speed, float harm, float radius, uint8_t group, bool isServer, uint32_t object, float angle)
     : mHarm(harm), mEnd(end), mCnt(0.0f),
     mSpeed(speed), mRadius(radius), mKind(kind),mTime(1e5f)
-    , mGroup(group), mObject(object), mAngle(angle) {
-    auto i = globalBullets.begin();
-    std::advance(i, kind);
-    mNode = i->second.getModel();
-    mHitRadius = i->second.getRadius();
+    , mGroup(group), mObject(object), mAngle(angle), mIsServer(isServer) {
+    auto&& bullet = getBullet(kind);
+    mNode = bullet.getModel(isServer);
+    mHitRadius = bullet.getRadius();
     mNode->setTranslation(begin);
     mSpeed /= 1000.0f;
 
@@ -78,19 +161,25 @@ BulletInstance::BulletInstance(uint16_t kind, Vector3 begin, Vector3 end,
         mTime = begin.distance(end) / mSpeed*1.5f;
 }
 
+BulletInstance::~BulletInstance() {
+    if (mNode)
+        getBullet(mKind).release(mNode.get(), mIsServer);
+}
+
 void BulletInstance::update(float delta) {
 
     if (mObject) {
         auto p =mObject==pointID?mEnd :localServer->getUnitPos(mObject);
         if (p.isZero())mHitRadius = 1e10f;
         else {
+            auto&& map = localServer->getMap();
             auto mp= mNode->getTranslation();
-            auto hl = localClient->getHeight(mp.x, mp.z) + 300.0f;
+            auto hl = map.getHeight(mp.x, mp.z) + 300.0f;
             Vector3 f;
             auto dis = mp.distanceSquared(p);
             if (mp.y > hl || dis < 3e5f) {
                 if (dis >= 3e5f)
-                    p.y = std::max(p.y, localClient->getHeight(p.x, p.z) + 500.0f);
+                    p.y = std::max(p.y, map.getHeight(p.x, p.z) + 500.0f);
                 f = p - mp;
             }
             else f = Vector3{ 0.0f,hl - mp.y,0.0f };
@@ -138,6 +227,7 @@ uint8_t BulletInstance::getGroup() const {
     return mGroup;
 }
 
+#ifndef TFL_HEADLESS
 void BulletInstance::updateClient(float delta) {
     std::function<void(Node*)> updateFire = [&](Node* node) {
         auto p = dynamic_cast<ParticleEmitter*>(node->getDrawable());
@@ -152,6 +242,7 @@ void BulletInstance::updateClient(float delta) {
 
     updateFire(mNode.get());
 }
+#endif // !TFL_HEADLESS
 
 Node * BulletInstance::getNode() const {
     return mNode.get();
@@ -3,21 +3,31 @@
 
 class Bullet final {
 private:
-    mutable uniqueRAII<Node> mModel;
+    mutable uniqueRAII<Node> mModel, mSkeleton;
     uniqueRAII<Node> mDuang;
     float mHitRadius,mBoomTime;
     std::string mModelPath;
+    friend void loadAllBullets();
+    uint16_t mID;
 public:
     void operator=(const std::string& name);
-    Node* getModel() const;
+    //the nodes come from the pools of the calling thread,release puts them back.
+    //the server gets the transforms of the model without meshes or materials.
+    Node* getModel(bool isServer) const;
+    void release(Node* model, bool isServer) const;
     float getRadius() const;
     Node* boom();
+    void releaseBoom(Node* emitter);
     float getBoomTime() const;
+    uint16_t getID() const;
 };
 
 extern std::map<std::string, Bullet> globalBullets;
 void loadAllBullets();
+//drops the pooled nodes of the calling thread.
+void clearBulletPools();
 Bullet& getBullet(uint16_t id);
+uint16_t getBulletID(const std::string& name);
 
 class BulletInstance final {
 private:
@@ -28,16 +38,22 @@ private:
     uint8_t mGroup;
     uint32_t mObject;
     float mAngle;
+    bool mIsServer;
     static uint32_t cnt;
 public:
     static uint32_t askID();
+    static void resetID();
     BulletInstance() {
         throw;
     }
+    BulletInstance(BulletInstance&&) = default;
+    BulletInstance& operator=(BulletInstance&&) = default;
+    ~BulletInstance();
+    //the controllers shoot on the server.
     BulletInstance(const std::string& kind, Vector3 begin, Vector3 end, Vector3 forward,
         float speed, float harm, float radius, uint8_t group, uint32_t obj=0,float angle=0.0f);
     BulletInstance(uint16_t kind, Vector3 begin,Vector3 end,
-        float speed,float harm,float radius, uint8_t group, uint32_t obj=0,float angle=0.0f);
+        float speed,float harm,float radius, uint8_t group, bool isServer, uint32_t obj=0,float angle=0.0f);
     void update(float delta);
     BoundingSphere getHitBound();
     BoundingSphere getBound();
@@ -45,6 +61,8 @@ public:
     uint16_t getKind() const;
     Node* getNode() const;
     uint8_t getGroup() const;
+#ifndef TFL_HEADLESS
     void updateClient(float delta);
+#endif // !TFL_HEADLESS
 };
 
@@ -1,6 +1,7 @@
 #include "Client.h"
 #include "Message.h"
 #include "Unit.h"
+#include "Loader.h"
 #include <thread>
 #include <chrono>
 using namespace std::literals;
@@ -117,7 +118,7 @@ void Client::move(int x, int y) {
 
 Client::Client(const std::string & server, bool& res) :
     mPeer(RakNet::RakPeerInterface::GetInstance()), mServer(server.c_str(), 23333),
-    mState(false), mWeight(globalUnits.size(), 1), mSpeed(1.0f), mRight(0), mFollower(0) {
+    mState(false), mWeight(globalUnits.size(), 1), mSpeed(1.0f), mRight(0), mFollower(0), mClock(0.0) {
 
     RakNet::SocketDescriptor SD;
     mPeer->Startup(1, &SD, 1);
@@ -197,7 +198,16 @@ void Client::changeGroup(uint8_t group) {
         , 0, mServer, false);
 }
 
+void Client::askStats() {
+    RakNet::BitStream stream;
+    stream.Write(ClientMessage::stats);
+    mPeer->Send(&stream, PacketPriority::LOW_PRIORITY, PacketReliability::RELIABLE_ORDERED
+        , 0, mServer, false);
+}
+
 Client::WaitResult Client::wait() {
+    //the menus call this every frame,so the models are built while the players gather.
+    resourceLoader.update(loadBudget);
     auto packet = mPeer->Receive();
     if (packet) {
         RakNet::BitStream data(packet->data, packet->length, false);
@@ -218,6 +228,20 @@ Client::WaitResult Client::wait() {
             RakNet::RakString str;
             data.Read(str);
             INFO("Loading map ", str.C_String());
+            //any kind may be produced in the match,so all of them are ready before it begins.
+            resourceLoader.prefetchDir("res/maps/"s + str.C_String());
+            resourceLoader.prefetchDir("res/common");
+            resourceLoader.prefetchDir("res/shared");
+            for (auto&& u : globalUnits) {
+                resourceLoader.prefetchDir("res/units/" + u.first);
+                auto kind = &u.second;
+                resourceLoader.post([kind] {uniqueRAII<Node> model = kind->getModel(); });
+            }
+            for (auto&& b : globalBullets) {
+                resourceLoader.prefetchDir("res/bullets/" + b.first);
+                auto kind = &b.second;
+                resourceLoader.post([kind] {uniqueRAII<Node> model = kind->getModel(false); });
+            }
             mMap = std::make_unique<Map>(str.C_String());
             mMiniMap = SpriteBatch::create(("res/maps/"s + str.C_String() + "/view.png").c_str());
             uniqueRAII<Scene> sky = Scene::load(("res/maps/"s + str.C_String() + "/sky.scene").c_str());
@@ -228,6 +252,8 @@ Client::WaitResult Client::wait() {
             data.Read(mSpeed);
         }
         CheckHeader(ServerMessage::go) {
+            resourceLoader.finish();
+            resourceLoader.clear();
 
             //lazy load
             if (!mFlagModel) {
@@ -274,7 +300,10 @@ void Client::stop() {
     mScene.reset();
     mCamera.reset();
     mUnits.clear();
+    mUnitMotion.clear();
+    mBulletMotion.clear();
     mDuang.clear();
+    clearBulletPools();
     mChoosed.clear();
     mHotPoint.clear();
     mProducingState.clear();
@@ -353,6 +382,7 @@ bool Client::update(float delta) {
     }
 #endif // WIN32
 
+    mClock += delta;
     delta *= mSpeed;
 
     auto isStop = false;
@@ -373,20 +403,26 @@ bool Client::update(float delta) {
             isStop = true;
             continue;
         }
-        CheckHeader(ServerMessage::updateUnit) {
+        CheckHeader(ServerMessage::snapshot) {
+            uint32_t time, seq;
+            const Snapshot* snapshot;
+            if (!mSnapshot.readMessage(data, time, seq, snapshot))continue;
+            {
+                RakNet::BitStream ack;
+                ack.Write(ClientMessage::ack);
+                ack.Write(seq);
+                mPeer->Send(&ack, PacketPriority::HIGH_PRIORITY,
+                    PacketReliability::UNRELIABLE, 0, mServer, false);
+            }
+
             mLoadSize.clear();
-            uint32_t size;
-            data.Read(size);
             std::set<uint32_t> old;
             for (auto&& u : mUnits)
                 old.insert(u.first);
-            for (uint32_t i = 0; i < size; ++i) {
-                UnitSyncInfo u;
-                data.Read(u);
+            for (auto&& u : snapshot->getUnits()) {
                 auto oi = old.find(u.id);
+                mUnitMotion[u.id].push(time, u.pos, u.rotation);
                 if (oi != old.cend()) {
-                    mUnits[u.id].getNode()->setTranslation(u.pos);
-                    mUnits[u.id].getNode()->setRotation(u.rotation);
                     if (u.at != pointID)
                         mUnits[u.id].setAttackTarget(u.at);
                     else
@@ -415,31 +451,31 @@ bool Client::update(float delta) {
             for (auto&& o : old) {
                 mScene->removeNode(mUnits[o].getNode());
                 mUnits.erase(o);
+                mUnitMotion.erase(o);
             }
-        }
-        CheckHeader(ServerMessage::updateBullet) {
-            uint32_t size;
-            data.Read(size);
-            std::set<uint32_t> old;
+
+            old.clear();
             for (auto&& x : mBullets)
                 old.insert(x.first);
-            for (uint32_t i = 0; i < size; ++i) {
-                BulletSyncInfo info;
-                data.Read(info);
+            for (auto&& info : snapshot->getBullets()) {
                 auto iter = old.find(info.id);
                 if (iter == old.cend()) {
-                    mBullets.insert({ info.id,std::move(BulletInstance(info.kind, {}, {}, 0.0f, 0.0f, 0.0f,0)) });
+                    mBullets.insert({ info.id,std::move(BulletInstance(info.kind, {}, {}, 0.0f, 0.0f, 0.0f, 0, false)) });
                     mScene->addNode(mBullets[info.id].getNode());
                 }
                 else old.erase(iter);
-                mBullets[info.id].getNode()->setTranslation(info.pos);
-                mBullets[info.id].getNode()->setRotation(info.rotation);
+                mBulletMotion[info.id].push(time, info.pos, info.rotation);
             }
 
             for (auto&& x : old) {
                 mScene->removeNode(mBullets[x].getNode());
                 mBullets.erase(x);
+                mBulletMotion.erase(x);
             }
+
+            //follow the server clock,jump only when it is far away.
+            auto error = time - mClock;
+            mClock = std::abs(error) > 1000.0 ? time : mClock + error*0.1;
         }
         CheckHeader(ServerMessage::updateState) {
             for (auto& x : mWeight)
@@ -458,7 +494,7 @@ bool Client::update(float delta) {
                 DuangSyncInfo info;
                 data.Read(info);
                 auto& bullet = getBullet(info.kind);
-                auto iter = mDuang.insert({ bullet.boom(),now + bullet.getBoomTime() }).first;
+                auto iter = mDuang.insert({ bullet.boom(),now + bullet.getBoomTime(),info.kind }).first;
                 mScene->addNode(iter->emitter.get());
                 iter->emitter->setTranslation(info.pos);
                 auto p = dynamic_cast<ParticleEmitter*>(iter->emitter->getDrawable());
@@ -469,6 +505,23 @@ bool Client::update(float delta) {
                 mAudio.play(AudioType::boom, info.pos);
             }
         }
+        CheckHeader(ServerMessage::stats) {
+            uint16_t ticks;
+            data.Read(ticks);
+            std::string str = "Server stats of " + to_string(ticks) + " ticks:";
+            for (size_t i = 0; i < phaseNum; ++i) {
+                float avg, max;
+                data.Read(avg);
+                data.Read(max);
+                str += to_string("\n", Profiler::getName(static_cast<Phase>(i)), " avg ", avg, "ms max ", max, "ms");
+            }
+            for (size_t i = 0; i < counterNum; ++i) {
+                float avg;
+                data.Read(avg);
+                str += to_string("\n", Profiler::getName(static_cast<Counter>(i)), " ", avg, "/tick");
+            }
+            INFO(str);
+        }
     }
 
     if (isStop || mPeer->GetConnectionState(mServer) != RakNet::IS_CONNECTED) {
@@ -477,6 +530,14 @@ bool Client::update(float delta) {
         return false;
     }
 
+    {
+        auto time = mClock - interpolationDelay;
+        for (auto&& x : mUnits)
+            mUnitMotion[x.first].apply(time, x.second.getNode());
+        for (auto&& x : mBullets)
+            mBulletMotion[x.first].apply(time, x.second.getNode());
+    }
+
     for (auto&& x : mUnits)
         x.second.update(delta);
 
@@ -489,7 +550,7 @@ bool Client::update(float delta) {
             else
                 dynamic_cast<ParticleEmitter*>(i->emitter->getDrawable())->update(delta);
         for (auto&& x : deferred) {
-            mScene->removeNode(x->emitter.get());
+            getBullet(x->kind).releaseBoom(x->emitter.get());
             mDuang.erase(x);
         }
 
@@ -829,6 +890,10 @@ float Client::getHeight(int x, int z) const {
     return mMap->getHeight(x, z);
 }
 
+void Client::getHeight(const Vector2* pos, float* res, size_t size) const {
+    mMap->getHeight(pos, res, size);
+}
+
 void Client::setViewport(uint32_t right) {
     if (mRight != right) {
         mRight = right;
@@ -6,10 +6,14 @@
 #include <list>
 #include "Audio.h"
 #include "Message.h"
+#include "Snapshot.h"
+#include "Motion.h"
+#include "Profiler.h"
 
 struct DuangInfo final {
     uniqueRAII<Node> emitter;
     float end;
+    uint16_t kind;
     bool operator<(const DuangInfo& rhs) const {
         return emitter.get() < rhs.emitter.get();
     }
@@ -19,6 +23,7 @@ class Client final:RenderState::AutoBindingResolver {
 private:
     RakNet::RakPeerInterface* mPeer;
     RakNet::SystemAddress mServer;
+    SnapshotDecoder mSnapshot;
     bool mState;
     uniqueRAII<Scene> mScene;
     uint32_t mRight;
@@ -29,6 +34,9 @@ private:
     std::vector<uint16_t> mWeight;
     std::map<uint32_t, UnitInstance> mUnits;
     std::map<uint32_t, BulletInstance> mBullets;
+    //the estimated server time in milliseconds and the states received for each object.
+    double mClock;
+    std::map<uint32_t, MotionBuffer> mUnitMotion, mBulletMotion;
     uniqueRAII<Node> mFlagModel;
     uint8_t mGroup;
     float mSpeed;
@@ -72,6 +80,8 @@ public:
     Client(const std::string& server,bool& res);
     ~Client();
     void changeGroup(uint8_t group);
+    //the server answers with the cost of its ticks in the last second,it is written to the log.
+    void askStats();
     enum class WaitResult {
         None,Disconnected,Go
     };
@@ -81,6 +91,7 @@ public:
     void render();
     Vector3 getPos(uint32_t& id);
     float getHeight(int x, int z) const;
+    void getHeight(const Vector2* pos, float* res, size_t size) const;
     AudioManager& getAudio();
     bool isMine(uint32_t id) const;
     //UI
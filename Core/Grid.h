@@ -0,0 +1,116 @@
+#pragma once
+#include "common.h"
+#include <unordered_map>
+
+//uniform grid over the map on the x/z plane,used as the broad phase of the server.
+template<typename T>
+class Grid final {
+public:
+    static constexpr auto cellSize = 100.0f;
+    static constexpr auto size = static_cast<int>(mapSizeF / cellSize) + 1;
+private:
+    struct Item final {
+        uint32_t id;
+        T value;
+        BoundingSphere bound;
+    };
+    std::vector<std::vector<Item>> mCells;
+    //objects whose bound is bigger than the map are always visited.
+    std::vector<Item> mHuge;
+    std::unordered_map<uint32_t, int> mIndex;
+    float mMaxRadius;
+
+    static constexpr auto huge = -1;
+
+    static int toCell(float x) {
+        auto c = static_cast<int>((x + mapSizeHF) / cellSize);
+        return std::min(std::max(c, 0), size - 1);
+    }
+
+    std::vector<Item>& getCell(int idx) {
+        return idx == huge ? mHuge : mCells[idx];
+    }
+
+    int locate(const BoundingSphere& bs) const {
+        if (bs.radius > mapSizeF)return huge;
+        return toCell(bs.center.x)*size + toCell(bs.center.z);
+    }
+public:
+    Grid() :mCells(size*size), mMaxRadius(0.0f) {}
+
+    void clear() {
+        for (auto&& c : mCells)
+            c.clear();
+        mHuge.clear();
+        mIndex.clear();
+        mMaxRadius = 0.0f;
+    }
+
+    void insert(uint32_t id, T value, const BoundingSphere& bs) {
+        auto idx = locate(bs);
+        getCell(idx).push_back({ id,value,bs });
+        mIndex[id] = idx;
+        if (idx != huge)
+            mMaxRadius = std::max(mMaxRadius, bs.radius);
+    }
+
+    void erase(uint32_t id) {
+        auto i = mIndex.find(id);
+        if (i == mIndex.cend())return;
+        auto&& cell = getCell(i->second);
+        auto it = std::find_if(cell.begin(), cell.end(), [id](const Item& x) {return x.id == id; });
+        if (it != cell.end()) {
+            *it = std::move(cell.back());
+            cell.pop_back();
+        }
+        mIndex.erase(i);
+    }
+
+    void update(uint32_t id, const BoundingSphere& bs) {
+        auto i = mIndex.find(id);
+        if (i == mIndex.cend())return;
+        auto&& cell = getCell(i->second);
+        auto it = std::find_if(cell.begin(), cell.end(), [id](const Item& x) {return x.id == id; });
+        if (it == cell.end())return;
+        auto idx = locate(bs);
+        if (idx == i->second)it->bound = bs;
+        else {
+            auto value = it->value;
+            erase(id);
+            insert(id, value, bs);
+        }
+    }
+
+    //visit every object whose cached bound may touch the circle (center,radius) on the x/z plane.
+    template<typename Func>
+    void query(Vector3 center, float radius, Func&& func) const {
+        for (auto&& x : mHuge)
+            func(x.id, x.value, x.bound);
+        auto r = radius + mMaxRadius;
+        auto bx = toCell(center.x - r), ex = toCell(center.x + r);
+        auto bz = toCell(center.z - r), ez = toCell(center.z + r);
+        for (auto ix = bx; ix <= ex; ++ix)
+            for (auto iz = bz; iz <= ez; ++iz)
+                for (auto&& x : mCells[ix*size + iz]) {
+                    auto dx = x.bound.center.x - center.x, dz = x.bound.center.z - center.z;
+                    auto d = radius + x.bound.radius;
+                    if (dx*dx + dz*dz <= d*d)
+                        func(x.id, x.value, x.bound);
+                }
+    }
+
+    template<typename Func>
+    void query(const BoundingSphere& bs, Func&& func) const {
+        query(bs.center, bs.radius, std::forward<Func>(func));
+    }
+
+    size_t count() const {
+        return mIndex.size();
+    }
+};
+
+//std::max takes them by reference,which needs the definitions before C++17.
+template<typename T>
+constexpr float Grid<T>::cellSize;
+template<typename T>
+constexpr int Grid<T>::size;
@@ -0,0 +1,132 @@
+#include "Loader.h"
+#include "Pak.h"
+#include "ThreadPool.h"
+#include <chrono>
+#include <set>
+
+namespace {
+    //the same as the Packer.
+    const std::set<std::string> exts = { ".config", ".form",".gpb",".theme",".png",
+        ".data",".info",".terrain",".material",".frag",
+        ".vert",".ogg",".scene",".physics" };
+
+    bool isAsset(const std::string& name) {
+        auto pos = name.find_last_of('.');
+        return pos != std::string::npos && exts.count(name.substr(pos));
+    }
+}
+
+ResourceLoader resourceLoader;
+
+ResourceLoader::Data ResourceLoader::read(const std::string& path) const {
+    auto res = std::make_shared<std::vector<char>>();
+    //FileSystem::open would ask this loader again,so the next provider and the disk are read directly.
+    uniqueRAII<Stream> stream = mNext ? mNext->open(path.c_str()) : nullptr;
+    if (stream) {
+        res->resize(stream->length());
+        if (res->size() && stream->read(res->data(), res->size(), 1) != 1)return nullptr;
+        return res;
+    }
+    auto file = FileSystem::openFile(path.c_str(), "rb");
+    if (!file)return nullptr;
+    char buffer[1 << 14];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        res->insert(res->end(), buffer, buffer + size);
+    fclose(file);
+    return res;
+}
+
+ResourceLoader::ResourceLoader() :mNext(nullptr) {}
+
+void ResourceLoader::setNext(FileSystem::Provider* next) {
+    clear();
+    mNext = next;
+}
+
+void ResourceLoader::prefetch(const std::string& path) {
+    auto name = normalizePath(path.c_str());
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mFiles.count(name))return;
+    //the name is lower case,the disk may not be.
+    mFiles.emplace(name, getThreadPool().submit([this, path] {return read(path); }).share());
+}
+
+void ResourceLoader::prefetchDir(const std::string& dirPath) {
+    std::vector<std::string> files, dirs;
+    FileSystem::listFiles(dirPath.c_str(), files);
+    for (auto&& f : files)
+        if (isAsset(f))
+            prefetch(dirPath + "/" + f);
+    listDirs(dirPath.c_str(), dirs);
+    for (auto&& d : dirs)
+        prefetchDir(dirPath + "/" + d);
+}
+
+void ResourceLoader::clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    //the workers may be reading a pak that is going to be unmounted.
+    for (auto&& f : mFiles)
+        f.second.wait();
+    mFiles.clear();
+}
+
+void ResourceLoader::post(std::function<void()>&& func) {
+    mTasks.emplace_back(std::move(func));
+}
+
+bool ResourceLoader::update(float budget) {
+    using clock = std::chrono::steady_clock;
+    auto end = clock::now() + std::chrono::duration<float, std::milli>(budget);
+    //at least one task runs,so a task longer than the budget cannot stall the queue.
+    do {
+        if (mTasks.empty())return true;
+        auto task = std::move(mTasks.front());
+        mTasks.pop_front();
+        task();
+    } while (clock::now() < end);
+    return mTasks.empty();
+}
+
+void ResourceLoader::finish() {
+    while (mTasks.size()) {
+        auto task = std::move(mTasks.front());
+        mTasks.pop_front();
+        task();
+    }
+}
+
+Stream* ResourceLoader::open(const char* path) {
+    std::shared_future<Data> file;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mFiles.find(normalizePath(path));
+        if (it != mFiles.cend()) {
+            //the engine caches what it has loaded,so a file is rarely opened twice.
+            file = std::move(it->second);
+            mFiles.erase(it);
+        }
+    }
+    if (file.valid()) {
+        //nobody else can reach the data once it has left the table.
+        auto data = file.get();
+        if (data)
+            return new MemoryStream(std::move(*data));
+    }
+    return mNext ? mNext->open(path) : nullptr;
+}
+
+bool ResourceLoader::fileExists(const char* path) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mFiles.find(normalizePath(path));
+        if (it != mFiles.cend() && (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready
+            || it->second.get()))
+            return true;
+    }
+    return mNext && mNext->fileExists(path);
+}
+
+bool ResourceLoader::listFiles(const char* dirPath, std::vector<std::string>& files) {
+    return mNext && mNext->listFiles(dirPath, files);
+}
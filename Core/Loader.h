@@ -0,0 +1,43 @@
+#pragma once
+#include "common.h"
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+
+//reads the files on the worker threads before they are used,the engine then opens them from memory.
+//the work that needs the renderer is queued and done on the main thread a little every frame.
+class ResourceLoader final :public FileSystem::Provider {
+private:
+    using Data = std::shared_ptr<std::vector<char>>;
+    std::mutex mMutex;
+    std::unordered_map<std::string, std::shared_future<Data>> mFiles;
+    FileSystem::Provider* mNext;
+    std::deque<std::function<void()>> mTasks;
+    Data read(const std::string& path) const;
+public:
+    ResourceLoader();
+    //the provider asked when a file has not been prefetched.
+    void setNext(FileSystem::Provider* next);
+    void prefetch(const std::string& path);
+    //the assets in the directory and its subdirectories.
+    void prefetchDir(const std::string& dirPath);
+    //drops the files nobody has opened.
+    void clear();
+
+    //runs func on the main thread in update or finish.
+    void post(std::function<void()>&& func);
+    //returns true when nothing is left,budget is in milliseconds.
+    bool update(float budget);
+    void finish();
+
+    Stream* open(const char* path) override;
+    bool fileExists(const char* path) override;
+    bool listFiles(const char* dirPath, std::vector<std::string>& files) override;
+};
+
+extern ResourceLoader resourceLoader;
+
+//milliseconds a frame may spend on the queued work.
+constexpr auto loadBudget = 4.0f;
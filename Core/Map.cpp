@@ -4,42 +4,343 @@
 #include <fstream>
 #include <Server.h>
 
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define MAP_USE_SSE
+#include <emmintrin.h>
+#endif
+
 Map::Map(const std::string & name) {
     std::string full = "/res/maps/" + name + "/";
     std::string map = full + "map.terrain";
     uniqueRAII<Properties> terrain = Properties::create(map.c_str());
-    mTerrain = Terrain::create(terrain.get());
     mSeaLevel = terrain->getFloat("seaLevel");
 
+#ifndef TFL_HEADLESS
+    mTerrain = Terrain::create(terrain.get());
     mTerrain->setFlag(Terrain::Flags::FRUSTUM_CULLING, true);
     mTerrain->setFlag(Terrain::Flags::LEVEL_OF_DETAIL, false);
+#endif // !TFL_HEADLESS
+
+    {
+        auto t = terrain->getNamespace("terrain", true);
+        Vector3 size;
+        t->getVector3("size", &size);
+        auto h = t->getNamespace("heightmap", true);
+        uniqueRAII<HeightField> field = HeightField::createFromImage(
+            h ? h->getString("path") : t->getString("heightmap"));
+        if (!field) GP_ERROR("Failed to read the heightmap of the map.");
+        mCols = field->getColumnCount();
+        mRows = field->getRowCount();
+        if (mCols != mRows || size.x != size.z) GP_ERROR("The map must be a square.");
+        mScale = (mCols - 1) / size.x;
+        mOffset = (mCols - 1)*0.5f;
+        auto stride = mCols + 1;
+        mHeight.resize(stride*(mRows + 1));
+        auto src = field->getArray();
+        for (uint32_t r = 0; r <= mRows; ++r)
+            for (uint32_t c = 0; c <= mCols; ++c)
+                mHeight[r*stride + c] = src[std::min(r, mRows - 1)*mCols + std::min(c, mCols - 1)]
+                * size.y - mSeaLevel;
+    }
 
     uniqueRAII<Properties> info = Properties::create((full + "map.info").c_str());
     const char* id;
     Vector2 tmp;
     while ((id = info->getNextProperty()) && info->getVector2(id, &tmp)) {
         mKeyPoint.emplace_back(tmp / 512.0f* mapSizeF - Vector2{ mapSizeHF, mapSizeHF });
+#ifndef TFL_HEADLESS
         mTerrain->setLayer(0, "res/common/key.png", { 16.0f,16.0f },
            nullptr, 0, tmp.y / 32, tmp.x / 32);
+#endif // !TFL_HEADLESS
     }
 
     if (mKeyPoint.size() < 4) GP_ERROR("The number of the map must be bigger than 3.");
 
+    buildNavigation();
+
 }
 
+#ifndef TFL_HEADLESS
 void Map::set(Node* node) {
     node->setDrawable(mTerrain.get());
     node->setTranslationY(-mSeaLevel);
 }
 
+Terrain * Map::get() const {
+    return mTerrain.get();
+}
+#endif // !TFL_HEADLESS
+
 const std::vector<Vector2>& Map::getKey() const {
     return mKeyPoint;
 }
 
 float Map::getHeight(float x, float z) const {
-    return mTerrain->getHeight(x, z)-mSeaLevel;
+    auto maxv = mCols - 1.0f;
+    auto c = std::min(std::max(x*mScale + mOffset, 0.0f), maxv);
+    auto r = std::min(std::max(z*mScale + mOffset, 0.0f), maxv);
+    auto ic = static_cast<uint32_t>(c), ir = static_cast<uint32_t>(r);
+    auto fc = c - ic, fr = r - ir;
+    auto stride = mCols + 1;
+    auto p = mHeight.data() + ir*stride + ic;
+    return (p[0] * (1.0f - fc) + p[1] * fc)*(1.0f - fr) + (p[stride] * (1.0f - fc) + p[stride + 1] * fc)*fr;
 }
 
-Terrain * Map::get() const {
-    return mTerrain.get();
+void Map::getHeight(const Vector2* pos, float* res, size_t size) const {
+    size_t i = 0;
+#ifdef MAP_USE_SSE
+    static_assert(sizeof(Vector2) == 2 * sizeof(float), "Vector2 must be packed.");
+    auto scale = _mm_set1_ps(mScale), offset = _mm_set1_ps(mOffset);
+    auto zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), maxv = _mm_set1_ps(mCols - 1.0f);
+    auto stride = mCols + 1;
+    alignas(16) int32_t ic[4], ir[4];
+    for (; i + 4 <= size; i += 4) {
+        auto a = _mm_loadu_ps(&pos[i].x), b = _mm_loadu_ps(&pos[i + 2].x);
+        auto x = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        auto z = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        auto c = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(x, scale), offset), zero), maxv);
+        auto r = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(z, scale), offset), zero), maxv);
+        auto vc = _mm_cvttps_epi32(c), vr = _mm_cvttps_epi32(r);
+        auto fc = _mm_sub_ps(c, _mm_cvtepi32_ps(vc)), fr = _mm_sub_ps(r, _mm_cvtepi32_ps(vr));
+        _mm_store_si128(reinterpret_cast<__m128i*>(ic), vc);
+        _mm_store_si128(reinterpret_cast<__m128i*>(ir), vr);
+        alignas(16) float h[4][4];
+        for (auto j = 0; j < 4; ++j) {
+            auto p = mHeight.data() + ir[j] * stride + ic[j];
+            h[0][j] = p[0], h[1][j] = p[1], h[2][j] = p[stride], h[3][j] = p[stride + 1];
+        }
+        auto fci = _mm_sub_ps(one, fc), fri = _mm_sub_ps(one, fr);
+        auto top = _mm_add_ps(_mm_mul_ps(_mm_load_ps(h[0]), fci), _mm_mul_ps(_mm_load_ps(h[1]), fc));
+        auto bottom = _mm_add_ps(_mm_mul_ps(_mm_load_ps(h[2]), fci), _mm_mul_ps(_mm_load_ps(h[3]), fc));
+        _mm_storeu_ps(res + i, _mm_add_ps(_mm_mul_ps(top, fri), _mm_mul_ps(bottom, fr)));
+    }
+#endif
+    for (; i < size; ++i)
+        res[i] = getHeight(pos[i].x, pos[i].y);
+}
+
+void Map::buildNavigation() {
+    constexpr auto num = navSize*navSize;
+    mLand.assign(num, false);
+    mStamp.assign(num, 0);
+    mCost.resize(num);
+    mFrom.resize(num);
+    mQuery = 0;
+    mFlowTick = 0;
+    std::vector<Vector2> pos(navSize);
+    std::vector<float> height(navSize);
+    for (uint32_t z = 0; z < navSize; ++z) {
+        for (uint32_t x = 0; x < navSize; ++x)
+            pos[x] = fromNavCell(z*navSize + x);
+        getHeight(pos.data(), height.data(), navSize);
+        for (uint32_t x = 0; x < navSize; ++x)
+            mLand[z*navSize + x] = height[x] >= 0.0f;
+    }
+}
+
+uint32_t Map::toNavCell(Vector2 p) {
+    auto clamp = [](float x) {
+        return static_cast<uint32_t>(std::min(std::max((x + mapSizeHF) / navCell, 0.0f), navSize - 1.0f));
+    };
+    return clamp(p.y)*navSize + clamp(p.x);
+}
+
+Vector2 Map::fromNavCell(uint32_t cell) {
+    return { (cell%navSize + 0.5f)*navCell - mapSizeHF,(cell / navSize + 0.5f)*navCell - mapSizeHF };
+}
+
+bool Map::isLand(uint32_t cell) const {
+    return mLand[cell];
+}
+
+bool Map::testLine(Vector2 b, Vector2 e) const {
+    if (e.x<-mapSizeHF || e.x>mapSizeHF || e.y<-mapSizeHF || e.y>mapSizeHF)
+        return false;
+    auto end = toNavCell(e);
+    if (!mLand[end])return false;
+
+    auto begin = toNavCell(b);
+    int ix = begin%navSize, iz = begin / navSize;
+    int tx = end%navSize, tz = end / navSize;
+    auto x = (b.x + mapSizeHF) / navCell, z = (b.y + mapSizeHF) / navCell;
+    auto dx = (e.x + mapSizeHF) / navCell - x, dz = (e.y + mapSizeHF) / navCell - z;
+    int sx = dx > 0.0f ? 1 : -1, sz = dz > 0.0f ? 1 : -1;
+    constexpr auto inf = std::numeric_limits<float>::infinity();
+    auto tdx = dx != 0.0f ? std::abs(1.0f / dx) : inf;
+    auto tdz = dz != 0.0f ? std::abs(1.0f / dz) : inf;
+    auto tmx = dx != 0.0f ? (dx > 0.0f ? ix + 1 - x : x - ix)*tdx : inf;
+    auto tmz = dz != 0.0f ? (dz > 0.0f ? iz + 1 - z : z - iz)*tdz : inf;
+
+    //the cell of the begin point is skipped so that units on the coast can leave it.
+    for (auto step = std::abs(tx - ix) + std::abs(tz - iz); step > 0; --step) {
+        if (tmx < tmz) ix += sx, tmx += tdx;
+        else iz += sz, tmz += tdz;
+        if (ix < 0 || ix >= navSize || iz < 0 || iz >= navSize || !mLand[iz*navSize + ix])
+            return false;
+    }
+    return true;
+}
+
+Vector2 Map::findWay(Vector2 b, Vector2 e) {
+    auto begin = toNavCell(b), end = toNavCell(e);
+    if (!mLand[end])return {};
+    if (begin == end)return e;
+
+    auto key = static_cast<uint64_t>(begin) << 32 | end;
+    auto iter = mWayCache.find(key);
+    if (iter != mWayCache.cend())return iter->second;
+    constexpr auto maxCache = 1U << 16;
+    if (mWayCache.size() >= maxCache)mWayCache.clear();
+
+    //A* on the navigation grid,bounded to keep the server tick stable.
+    constexpr auto maxExpand = 16384U;
+    ++mQuery;
+    auto ex = static_cast<int>(end%navSize), ez = static_cast<int>(end / navSize);
+    auto h = [ex, ez](uint32_t c) {
+        auto dx = std::abs(static_cast<int>(c%navSize) - ex), dz = std::abs(static_cast<int>(c / navSize) - ez);
+        return std::max(dx, dz) + 0.4142f*std::min(dx, dz);
+    };
+    std::priority_queue<OpenInfo, std::vector<OpenInfo>, std::greater<OpenInfo>> open;
+    mStamp[begin] = mQuery, mCost[begin] = 0.0f, mFrom[begin] = begin;
+    open.emplace(h(begin), begin);
+    auto found = false;
+    for (uint32_t expanded = 0; open.size() && expanded < maxExpand;) {
+        auto cur = open.top();
+        open.pop();
+        auto c = cur.second;
+        if (c == end) {
+            found = true;
+            break;
+        }
+        if (cur.first > mCost[c] + h(c) + 1e-3f)continue;
+        ++expanded;
+        int cx = c%navSize, cz = c / navSize;
+        for (auto ox = -1; ox <= 1; ++ox)
+            for (auto oz = -1; oz <= 1; ++oz) {
+                auto nx = cx + ox, nz = cz + oz;
+                if ((ox == 0 && oz == 0) || nx < 0 || nx >= navSize || nz < 0 || nz >= navSize)continue;
+                uint32_t n = nz*navSize + nx;
+                if (!mLand[n])continue;
+                if (ox && oz && !(mLand[cz*navSize + nx] && mLand[nz*navSize + cx]))continue;
+                auto cost = mCost[c] + (ox && oz ? 1.4142f : 1.0f);
+                if (mStamp[n] != mQuery || cost < mCost[n]) {
+                    mStamp[n] = mQuery, mCost[n] = cost, mFrom[n] = c;
+                    open.emplace(cost + h(n), n);
+                }
+            }
+    }
+
+    Vector2 res;
+    if (found) {
+        std::vector<uint32_t> path;
+        for (auto c = end; c != begin; c = mFrom[c])
+            path.push_back(c);
+        auto center = fromNavCell(begin);
+        res = fromNavCell(path.back());
+        for (auto i = path.rbegin(); i != path.rend(); ++i) {
+            auto p = *i == end ? e : fromNavCell(*i);
+            if (!testLine(center, p))break;
+            res = p;
+        }
+    }
+    mWayCache[key] = res;
+    return res;
+}
+
+bool Map::getFlow(Vector2 b, Vector2 e, Vector2& way) {
+    constexpr auto inf = std::numeric_limits<float>::infinity();
+    auto end = toNavCell(e);
+    if (!mLand[end]) {
+        way = {};
+        return true;
+    }
+
+    auto iter = mFlow.find(end);
+    if (iter == mFlow.end()) {
+        constexpr auto maxFlow = 16U;
+        if (mFlow.size() >= maxFlow)
+            mFlow.erase(std::min_element(mFlow.begin(), mFlow.end(), [](auto&& lhs, auto&& rhs) {
+            return lhs.second.last < rhs.second.last;
+        }));
+        iter = mFlow.emplace(end, FlowField{}).first;
+        iter->second.dis.assign(navSize*navSize, inf);
+        iter->second.dis[end] = 0.0f;
+        iter->second.open.emplace(0.0f, end);
+    }
+    auto&& field = iter->second;
+    field.last = mFlowTick;
+
+    auto begin = toNavCell(b);
+    if (begin == end) {
+        way = e;
+        return true;
+    }
+
+    //follow the field downhill for a few cells and keep the farthest one in sight.
+    constexpr auto look = 8;
+    auto cur = begin;
+    auto way0 = b;
+    auto found = false;
+    for (auto i = 0; i < look && cur != end; ++i) {
+        int cx = cur%navSize, cz = cur / navSize;
+        auto next = cur;
+        auto min = field.dis[cur];
+        for (auto ox = -1; ox <= 1; ++ox)
+            for (auto oz = -1; oz <= 1; ++oz) {
+                auto nx = cx + ox, nz = cz + oz;
+                if (nx < 0 || nx >= navSize || nz < 0 || nz >= navSize)continue;
+                uint32_t n = nz*navSize + nx;
+                if (field.dis[n] < min)min = field.dis[n], next = n;
+            }
+        if (next == cur)break;
+        cur = next;
+        auto p = cur == end ? e : fromNavCell(cur);
+        if (found && !testLine(b, p))break;
+        way0 = p;
+        found = true;
+    }
+
+    if (!found) {
+        if (field.open.size())return false;
+        way = {};
+        return true;
+    }
+    way = way0;
+    return true;
+}
+
+void Map::updateFlow() {
+    ++mFlowTick;
+    constexpr auto keep = 600U;
+    for (auto i = mFlow.begin(); i != mFlow.end();) {
+        if (mFlowTick - i->second.last > keep)i = mFlow.erase(i);
+        else ++i;
+    }
+
+    constexpr auto budget = 32768U;
+    uint32_t cnt = 0;
+    for (auto&& x : mFlow) {
+        auto&& field = x.second;
+        while (field.open.size() && cnt < budget) {
+            auto cur = field.open.top();
+            field.open.pop();
+            auto c = cur.second;
+            if (cur.first > field.dis[c])continue;
+            ++cnt;
+            int cx = c%navSize, cz = c / navSize;
+            for (auto ox = -1; ox <= 1; ++ox)
+                for (auto oz = -1; oz <= 1; ++oz) {
+                    auto nx = cx + ox, nz = cz + oz;
+                    if ((ox == 0 && oz == 0) || nx < 0 || nx >= navSize || nz < 0 || nz >= navSize)continue;
+                    uint32_t n = nz*navSize + nx;
+                    if (!mLand[n])continue;
+                    if (ox && oz && !(mLand[cz*navSize + nx] && mLand[nz*navSize + cx]))continue;
+                    auto d = field.dis[c] + (ox && oz ? 1.4142f : 1.0f);
+                    if (d < field.dis[n]) {
+                        field.dis[n] = d;
+                        field.open.emplace(d, n);
+                    }
+                }
+        }
+    }
 }
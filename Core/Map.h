@@ -1,15 +1,55 @@
 #pragma once
 #include "common.h"
+#include <unordered_map>
+#include <queue>
 
 class Map final {
 private:
+#ifndef TFL_HEADLESS
     uniqueRAII<Terrain> mTerrain;
+#endif // !TFL_HEADLESS
     std::vector<Vector2> mKeyPoint;
     float mSeaLevel;
+    //heights relative to the sea level,padded with one extra row and column.
+    std::vector<float> mHeight;
+    uint32_t mCols, mRows;
+    //world x/z -> heightfield column/row
+    float mScale, mOffset;
+
+    //navigation grid for units which can't cross the water.
+    std::vector<bool> mLand;
+    std::unordered_map<uint64_t, Vector2> mWayCache;
+    std::vector<uint32_t> mStamp;
+    std::vector<float> mCost;
+    std::vector<uint32_t> mFrom;
+    uint32_t mQuery;
+    void buildNavigation();
+
+    //distance fields shared by the units moving to the same cell,built over several ticks.
+    using OpenInfo = std::pair<float, uint32_t>;
+    struct FlowField final {
+        std::vector<float> dis;
+        std::priority_queue<OpenInfo, std::vector<OpenInfo>, std::greater<OpenInfo>> open;
+        uint32_t last;
+    };
+    std::unordered_map<uint32_t, FlowField> mFlow;
+    uint32_t mFlowTick;
 public:
+    static constexpr auto navSize = 256;
+    static constexpr auto navCell = mapSizeF / navSize;
+    static uint32_t toNavCell(Vector2 p);
+    static Vector2 fromNavCell(uint32_t cell);
     Map(const std::string& name);
+#ifndef TFL_HEADLESS
     void set(Node* node);
+    Terrain* get() const;
+#endif // !TFL_HEADLESS
     const std::vector<Vector2>& getKey() const;
     float getHeight(float x, float z) const;
-    Terrain* get() const;
+    void getHeight(const Vector2* pos, float* res, size_t size) const;
+    bool isLand(uint32_t cell) const;
+    bool testLine(Vector2 b, Vector2 e) const;
+    Vector2 findWay(Vector2 b, Vector2 e);
+    bool getFlow(Vector2 b, Vector2 e, Vector2& way);
+    void updateFlow();
 };
@@ -11,21 +11,23 @@ enum class ClientMessage : unsigned char {
     setMoveTarget,
     moveUnit,
     load,
-    release
+    release,
+    ack,
+    stats
 };
 
 enum class ServerMessage : unsigned char {
     begin = ID_USER_PACKET_ENUM,
     info,
     go,
-    updateUnit,
+    snapshot,
     updateState,
-    updateBullet,
 	changeSpeed,
     duang,
     win,
     out,
-    stop
+    stop,
+    stats
 };
 
 #define CheckBegin if(false)
@@ -0,0 +1,36 @@
+#include "Motion.h"
+
+void MotionBuffer::push(double time, const Vector3& pos, const Quaternion& rotation) {
+    while (mSamples.size() && mSamples.back().time >= time)
+        mSamples.pop_back();
+    mSamples.push_back({ time,pos,rotation });
+}
+
+void MotionBuffer::apply(double time, Node* node) {
+    if (mSamples.empty())return;
+    while (mSamples.size() > 2 && mSamples[1].time <= time)
+        mSamples.pop_front();
+
+    auto&& first = mSamples.front();
+    if (time <= first.time || mSamples.size() == 1) {
+        node->setTranslation(first.pos);
+        node->setRotation(first.rotation);
+        return;
+    }
+
+    auto&& a = mSamples[0];
+    auto&& b = mSamples[1];
+    auto span = b.time - a.time;
+    if (time <= b.time) {
+        auto t = static_cast<float>((time - a.time) / span);
+        Quaternion rotation;
+        Quaternion::slerp(a.rotation, b.rotation, t, &rotation);
+        node->setTranslation(a.pos + (b.pos - a.pos)*t);
+        node->setRotation(rotation);
+    }
+    else {
+        auto t = static_cast<float>(std::min(time - b.time, maxExtrapolation) / span);
+        node->setTranslation(b.pos + (b.pos - a.pos)*t);
+        node->setRotation(b.rotation);
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "common.h"
+#include <deque>
+
+//the latest states of a networked object,stamped with the server time in milliseconds.
+//the client draws them a little in the past so that there are always two states to blend.
+class MotionBuffer final {
+private:
+    struct Sample final {
+        double time;
+        Vector3 pos;
+        Quaternion rotation;
+    };
+    std::deque<Sample> mSamples;
+public:
+    //a lost snapshot is covered for at most this long,then the object stays at its last state.
+    static constexpr auto maxExtrapolation = 250.0;
+    void push(double time, const Vector3& pos, const Quaternion& rotation);
+    void apply(double time, Node* node);
+};
@@ -0,0 +1,417 @@
+#include "Pak.h"
+#include "ThreadPool.h"
+#include <zlib.h>
+#include <atomic>
+#include <set>
+#include <functional>
+#include <cctype>
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+uint64_t hashData(const void* data, size_t size) {
+    uint64_t res = 14695981039346656037ULL;
+    auto p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        res ^= p[i];
+        res *= 1099511628211ULL;
+    }
+    return res;
+}
+
+uint64_t hashPath(const char* path) {
+    return hashData(path, strlen(path));
+}
+
+std::string normalizePath(const char* path) {
+    std::string res(path);
+    std::replace(res.begin(), res.end(), '\\', '/');
+    std::transform(res.begin(), res.end(), res.begin(),
+        [](unsigned char c) {return static_cast<char>(std::tolower(c)); });
+    size_t begin = 0;
+    while (true) {
+        if (res.compare(begin, 1, "/") == 0)++begin;
+        else if (res.compare(begin, 2, "./") == 0)begin += 2;
+        else break;
+    }
+    return res.substr(begin);
+}
+
+MemoryStream::MemoryStream(const char* data, size_t size) :mData(data), mSize(size), mPos(0) {}
+
+MemoryStream::MemoryStream(std::vector<char>&& data)
+    :mOwned(std::move(data)), mData(mOwned.data()), mSize(mOwned.size()), mPos(0) {}
+
+bool MemoryStream::canRead() {
+    return true;
+}
+
+bool MemoryStream::canWrite() {
+    return false;
+}
+
+bool MemoryStream::canSeek() {
+    return true;
+}
+
+void MemoryStream::close() {}
+
+size_t MemoryStream::read(void* ptr, size_t size, size_t count) {
+    if (size == 0)return 0;
+    count = std::min(count, (mSize - mPos) / size);
+    std::memcpy(ptr, mData + mPos, size*count);
+    mPos += size*count;
+    return count;
+}
+
+char* MemoryStream::readLine(char* str, int num) {
+    if (num <= 0 || mPos >= mSize)return nullptr;
+    size_t i = 0;
+    while (i + 1 < static_cast<size_t>(num) && mPos < mSize) {
+        auto c = mData[mPos++];
+        str[i++] = c;
+        if (c == '\n')break;
+    }
+    str[i] = '\0';
+    return str;
+}
+
+size_t MemoryStream::write(const void*, size_t, size_t) {
+    return 0;
+}
+
+bool MemoryStream::eof() {
+    return mPos >= mSize;
+}
+
+size_t MemoryStream::length() {
+    return mSize;
+}
+
+long int MemoryStream::position() {
+    return static_cast<long int>(mPos);
+}
+
+bool MemoryStream::seek(long int offset, int origin) {
+    long int base = origin == SEEK_CUR ? position() : (origin == SEEK_END ? static_cast<long int>(mSize) : 0);
+    auto pos = base + offset;
+    if (pos < 0 || static_cast<size_t>(pos) > mSize)return false;
+    mPos = pos;
+    return true;
+}
+
+bool MemoryStream::rewind() {
+    mPos = 0;
+    return true;
+}
+
+namespace {
+    //the blocks are independent,the big files are unpacked by all the workers.
+    bool unpack(const char* data, const PakEntry& entry, std::vector<char>& res) {
+        res.resize(entry.size);
+        auto num = (entry.size + pakBlockSize - 1) / pakBlockSize;
+        if (static_cast<uint64_t>(num) * sizeof(uint32_t) > entry.packedSize)return false;
+        std::vector<uint32_t> sizes(num);
+        std::vector<size_t> offsets(num);
+        std::memcpy(sizes.data(), data, num * sizeof(uint32_t));
+        size_t pos = num * sizeof(uint32_t);
+        for (uint32_t i = 0; i < num; ++i) {
+            offsets[i] = pos;
+            pos += sizes[i];
+        }
+        if (pos > entry.packedSize)return false;
+
+        std::atomic<bool> ok(true);
+        auto block = [&](size_t i) {
+            auto begin = i * pakBlockSize;
+            uLongf size = std::min<size_t>(pakBlockSize, entry.size - begin);
+            auto expected = size;
+            if (uncompress(reinterpret_cast<Bytef*>(res.data() + begin), &size,
+                reinterpret_cast<const Bytef*>(data + offsets[i]), sizes[i]) != Z_OK || size != expected)
+                ok = false;
+        };
+        if (num > 1)
+            getThreadPool().parallelFor(num, block);
+        else if (num)
+            block(0);
+        return ok;
+    }
+}
+
+std::vector<PakHeader> listPaks() {
+    std::vector<std::string> names;
+    FileSystem::listFiles("paks", names);
+    names.erase(std::remove_if(names.begin(), names.end(),
+        [](const std::string& name) {return !(name.size() > 4
+            && name.substr(name.size() - 4, 4) == ".pak"); }), names.end());
+    std::sort(names.begin(), names.end());
+
+    std::vector<PakHeader> paks;
+    for (auto&& name : names) {
+        uniqueRAII<Stream> data = FileSystem::open(("paks/" + name).c_str());
+        if (!data)continue;
+        PakHeader p;
+        p.name = name;
+        p.size = data->length();
+        uint8_t num = 0;
+        data->read(&p.local, sizeof(p.local), 1);
+        data->read(&p.key, sizeof(p.key), 1);
+        data->read(&num, sizeof(num), 1);
+        char str[33] = {};
+        for (uint8_t i = 0; i < num; ++i) {
+            data->read(str, 32, 1);
+            p.bases.emplace_back(str);
+        }
+        p.headerSize = data->position();
+        uint32_t magic = 0;
+        p.indexed = data->read(&magic, sizeof(magic), 1) && magic == pakMagic;
+        paks.emplace_back(std::move(p));
+    }
+
+    std::vector<PakHeader> res;
+    std::vector<uint8_t> state(paks.size());//0:new 1:visiting 2:done
+    std::function<void(size_t)> visit = [&](size_t id) {
+        if (state[id] == 2)return;
+        if (state[id] == 1)GP_ERROR("Circular reference.");
+        state[id] = 1;
+        for (auto&& b : paks[id].bases) {
+            auto it = std::find_if(paks.cbegin(), paks.cend(), [&](auto&& x) {return x.name == b; });
+            if (it == paks.cend())
+                GP_ERROR("The pak %s is based on a missing pak named %s.", paks[id].name.c_str(), b.c_str());
+            visit(it - paks.cbegin());
+        }
+        state[id] = 2;
+        res.emplace_back(std::move(paks[id]));
+    };
+    for (size_t i = 0; i < paks.size(); ++i)
+        visit(i);
+    return res;
+}
+
+bool PakManifest::read(const char* path) {
+    files.clear();
+    uniqueRAII<Stream> data = FileSystem::open(path);
+    uint32_t num;
+    if (!data || !data->read(&key, sizeof(key), 1) || !data->read(&num, sizeof(num), 1))return false;
+    for (uint32_t i = 0; i < num; ++i) {
+        ManifestEntry entry;
+        uint16_t size;
+        if (!data->read(&entry.hash, sizeof(entry.hash), 1) || !data->read(&entry.unpacked, sizeof(entry.unpacked), 1)
+            || !data->read(&size, sizeof(size), 1))return false;
+        std::string name(size, '\0');
+        if (size && !data->read(&name[0], size, 1))return false;
+        files.emplace(std::move(name), entry);
+    }
+    return true;
+}
+
+bool PakManifest::write(const char* path) const {
+    uniqueRAII<Stream> data = FileSystem::open(path, FileSystem::WRITE);
+    if (!data)return false;
+    uint32_t num = files.size();
+    data->write(&key, sizeof(key), 1);
+    data->write(&num, sizeof(num), 1);
+    for (auto&& f : files) {
+        uint16_t size = f.first.size();
+        data->write(&f.second.hash, sizeof(f.second.hash), 1);
+        data->write(&f.second.unpacked, sizeof(f.second.unpacked), 1);
+        data->write(&size, sizeof(size), 1);
+        data->write(f.first.data(), size, 1);
+    }
+    return true;
+}
+
+struct PakFileSystem::Mapping final {
+#ifdef WIN32
+    HANDLE file = INVALID_HANDLE_VALUE, map = NULL;
+#endif
+    void* data = nullptr;
+    size_t size = 0;
+    ~Mapping() {
+#ifdef WIN32
+        if (data)UnmapViewOfFile(data);
+        if (map)CloseHandle(map);
+        if (file != INVALID_HANDLE_VALUE)CloseHandle(file);
+#else
+        if (data)munmap(data, size);
+#endif
+    }
+    bool open(const std::string& path) {
+#ifdef WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+        if (file == INVALID_HANDLE_VALUE)return false;
+        LARGE_INTEGER length;
+        if (!GetFileSizeEx(file, &length) || length.QuadPart == 0)return false;
+        size = static_cast<size_t>(length.QuadPart);
+        map = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!map)return false;
+        data = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+        return data != nullptr;
+#else
+        auto fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)return false;
+        struct stat buf;
+        if (fstat(fd, &buf) || buf.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        size = buf.st_size;
+        data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        //the mapping keeps the file alive.
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            data = nullptr;
+            return false;
+        }
+        return true;
+#endif
+    }
+};
+
+PakFileSystem pakFileSystem;
+
+PakFileSystem::PakFileSystem() = default;
+PakFileSystem::~PakFileSystem() = default;
+
+bool PakFileSystem::mount(const std::string& path) {
+    std::unique_ptr<Mapping> mapping = std::make_unique<Mapping>();
+    if (!mapping->open(FileSystem::getResourcePath() + path)) {
+        INFO("Failed to map the pak ", path);
+        return false;
+    }
+    Pak pak;
+    pak.base = static_cast<const char*>(mapping->data);
+    pak.size = mapping->size;
+
+    size_t pos = sizeof(bool) + sizeof(uint64_t);
+    if (pos + 1 > pak.size)return false;
+    pos += 1 + 32 * static_cast<uint8_t>(pak.base[pos]);
+    uint32_t magic;
+    if (pos + sizeof(magic) + sizeof(pak.count) > pak.size)return false;
+    std::memcpy(&magic, pak.base + pos, sizeof(magic));
+    if (magic != pakMagic)return false;
+    pos += sizeof(magic);
+    std::memcpy(&pak.count, pak.base + pos, sizeof(pak.count));
+    pos += sizeof(pak.count);
+    pak.table = pak.base + pos;
+    if (pos + static_cast<size_t>(pak.count) * sizeof(PakEntry) > pak.size) {
+        INFO("The pak ", path, " is broken.");
+        return false;
+    }
+
+    pak.mapping = std::move(mapping);
+    mPaks.emplace_back(std::move(pak));
+    INFO("Mounted ", path, " (", mPaks.back().count, " files)");
+    return true;
+}
+
+void PakFileSystem::clear() {
+    mPaks.clear();
+}
+
+bool PakFileSystem::find(const char* path, const char*& data, PakEntry& entry) const {
+    if (mPaks.empty())return false;
+    auto name = normalizePath(path);
+    auto hash = hashPath(name.c_str());
+    for (auto it = mPaks.crbegin(); it != mPaks.crend(); ++it) {
+        //the table may be unaligned in the mapping,so the entries are copied out.
+        auto get = [&](uint32_t i) {
+            std::memcpy(&entry, it->table + static_cast<size_t>(i) * sizeof(PakEntry), sizeof(PakEntry));
+        };
+        uint32_t begin = 0, end = it->count;
+        while (begin < end) {
+            auto mid = begin + (end - begin) / 2;
+            get(mid);
+            if (entry.hash < hash)begin = mid + 1;
+            else end = mid;
+        }
+        for (; begin < it->count; ++begin) {
+            get(begin);
+            if (entry.hash != hash)break;
+            //the entries keep the case of the files,only their hashes are lower case.
+            if (normalizePath(std::string(entry.name, strnlen(entry.name, sizeof(entry.name))).c_str()) == name) {
+                if (entry.offset + entry.packedSize > it->size)return false;
+                data = it->base + entry.offset;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+Stream* PakFileSystem::open(const char* path) {
+    const char* data;
+    PakEntry entry;
+    if (!find(path, data, entry))return nullptr;
+    switch (entry.codec) {
+        case PakCodec::store:
+            return new MemoryStream(data, entry.size);
+        case PakCodec::deflate:
+        {
+            std::vector<char> res;
+            if (unpack(data, entry, res))
+                return new MemoryStream(std::move(res));
+            break;
+        }
+    }
+    INFO("Failed to unpack ", path);
+    return nullptr;
+}
+
+bool PakFileSystem::fileExists(const char* path) {
+    const char* data;
+    PakEntry entry;
+    return find(path, data, entry);
+}
+
+template<typename Func>
+void PakFileSystem::forEach(const char* dirPath, Func&& func) const {
+    auto dir = normalizePath(dirPath ? dirPath : "");
+    if (dir.size() && dir.back() != '/')dir.push_back('/');
+    PakEntry entry;
+    for (auto&& p : mPaks)
+        for (uint32_t i = 0; i < p.count; ++i) {
+            std::memcpy(&entry, p.table + static_cast<size_t>(i) * sizeof(PakEntry), sizeof(PakEntry));
+            std::string name(entry.name, strnlen(entry.name, sizeof(entry.name)));
+            if (normalizePath(name.c_str()).compare(0, dir.size(), dir) == 0)
+                func(name.substr(dir.size()));
+        }
+}
+
+bool PakFileSystem::listFiles(const char* dirPath, std::vector<std::string>& files) {
+    std::set<std::string> res;
+    auto known = false;
+    forEach(dirPath, [&](std::string&& rest) {
+        known = true;
+        if (rest.find('/') == std::string::npos)
+            res.emplace(std::move(rest));
+    });
+    files.insert(files.end(), res.begin(), res.end());
+    return known;
+}
+
+void PakFileSystem::collect(PakManifest& manifest) const {
+    PakEntry entry;
+    for (auto&& p : mPaks)
+        for (uint32_t i = 0; i < p.count; ++i) {
+            std::memcpy(&entry, p.table + static_cast<size_t>(i) * sizeof(PakEntry), sizeof(PakEntry));
+            std::string name(entry.name, strnlen(entry.name, sizeof(entry.name)));
+            manifest.files[name] = { entry.contentHash,false };
+        }
+}
+
+bool PakFileSystem::listDirs(const char* dirPath, std::vector<std::string>& dirs) const {
+    std::set<std::string> res;
+    auto known = false;
+    forEach(dirPath, [&](std::string&& rest) {
+        known = true;
+        auto pos = rest.find('/');
+        if (pos != std::string::npos)
+            res.emplace(rest.substr(0, pos));
+    });
+    dirs.insert(dirs.end(), res.begin(), res.end());
+    return known;
+}
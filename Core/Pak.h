@@ -0,0 +1,121 @@
+#pragma once
+#include "common.h"
+#include <map>
+
+//a pak starts with a header:local(bool),key(uint64),the number and the names(char[32]) of its bases.
+//an indexed pak follows it with pakMagic,the number of files and the table of contents sorted by hash,
+//then the files themselves.the old paks have the files right after the header.
+enum class PakCodec : uint32_t {
+    store,
+    //the file is cut into pakBlockSize blocks compressed by zlib one by one,
+    //the packed sizes of the blocks(uint32) come before them.
+    deflate
+};
+
+struct PakEntry final {
+    uint64_t hash;
+    uint64_t offset;
+    //of the unpacked file.
+    uint64_t contentHash;
+    uint32_t size;
+    uint32_t packedSize;
+    PakCodec codec;
+    char name[60];
+};
+static_assert(sizeof(PakEntry) == 96, "The table of contents is written as is by the Packer.");
+
+constexpr uint32_t pakMagic = 0x324B5054;//TPK2
+constexpr uint32_t pakBlockSize = 1U << 16;
+
+//FNV-1a,the Packer hashes the paths and the files the same way.
+uint64_t hashData(const void* data, size_t size);
+uint64_t hashPath(const char* path);
+
+struct PakHeader final {
+    std::string name;
+    bool local;
+    uint64_t key;
+    std::vector<std::string> bases;
+    bool indexed;
+    //where the table of contents or the files begin.
+    uint32_t headerSize;
+    uint64_t size;
+};
+
+//the names in the paks look like res/units/x/unit.info.
+//the result is lower case,the paks are looked up regardless of case like the files on Windows.
+std::string normalizePath(const char* path);
+
+//a read-only view of a file in a mapping or of its own copy.
+class MemoryStream final :public Stream {
+private:
+    std::vector<char> mOwned;
+    const char* mData;
+    size_t mSize, mPos;
+public:
+    //the mapping outlives the stream.
+    MemoryStream(const char* data, size_t size);
+    explicit MemoryStream(std::vector<char>&& data);
+    bool canRead() override;
+    bool canWrite() override;
+    bool canSeek() override;
+    void close() override;
+    size_t read(void* ptr, size_t size, size_t count) override;
+    char* readLine(char* str, int num) override;
+    size_t write(const void* ptr, size_t size, size_t count) override;
+    bool eof() override;
+    size_t length() override;
+    long int position() override;
+    bool seek(long int offset, int origin) override;
+    bool rewind() override;
+};
+
+//the paks in paks/,every pak comes after its bases.
+std::vector<PakHeader> listPaks();
+
+struct ManifestEntry final {
+    uint64_t hash;
+    //the file was unpacked to res by an old pak,otherwise it is in a mounted pak.
+    bool unpacked;
+};
+
+//the files the paks provided last time,so an update only writes and reports what changed.
+struct PakManifest final {
+    //of the paks that are unpacked.
+    uint64_t key = 0;
+    std::map<std::string, ManifestEntry> files;
+    bool read(const char* path);
+    bool write(const char* path) const;
+};
+
+//serves the files of the indexed paks straight from their mappings,
+//a pak mounted later overrides the files of the ones before it.
+class PakFileSystem final :public FileSystem::Provider {
+private:
+    struct Mapping;
+    struct Pak final {
+        std::unique_ptr<Mapping> mapping;
+        const char* base;
+        size_t size;
+        const char* table;
+        uint32_t count;
+    };
+    std::vector<Pak> mPaks;
+    bool find(const char* path, const char*& data, PakEntry& entry) const;
+    template<typename Func>
+    void forEach(const char* dirPath, Func&& func) const;
+public:
+    PakFileSystem();
+    ~PakFileSystem();
+    //path is relative to the resource path,returns false when it is not an indexed pak.
+    bool mount(const std::string& path);
+    void clear();
+    Stream* open(const char* path) override;
+    bool fileExists(const char* path) override;
+    bool listFiles(const char* dirPath, std::vector<std::string>& files) override;
+    bool listDirs(const char* dirPath, std::vector<std::string>& dirs) const;
+    //adds the files of the mounted paks,they override the ones on disk.
+    void collect(PakManifest& manifest) const;
+};
+
+extern PakFileSystem pakFileSystem;
@@ -0,0 +1,118 @@
+#include "Profiler.h"
+#include <fstream>
+
+float Profiler::elapsed(clock::time_point from, clock::time_point to) const {
+    return std::chrono::duration<float, std::milli>(to - from).count();
+}
+
+Profiler::Profiler() :mHead(0), mCurrent{}, mOrigin(clock::now()), mStart(mOrigin), mLast(mOrigin) {
+    for (auto&& s : mRing)
+        s.seq.store(0, std::memory_order_relaxed);
+}
+
+void Profiler::begin(uint32_t tick) {
+    mCurrent = {};
+    mCurrent.tick = tick;
+    mStart = mLast = clock::now();
+    mCurrent.start = std::chrono::duration<double, std::micro>(mStart - mOrigin).count();
+}
+
+void Profiler::lap(Phase phase) {
+    auto now = clock::now();
+    auto idx = static_cast<size_t>(phase);
+    mCurrent.begin[idx] = elapsed(mStart, mLast);
+    mCurrent.time[idx] += elapsed(mLast, now);
+    mLast = now;
+}
+
+void Profiler::count(Counter counter, uint32_t num) {
+    mCurrent.count[static_cast<size_t>(counter)] += num;
+}
+
+void Profiler::end() {
+    auto head = mHead.load(std::memory_order_relaxed);
+    auto&& slot = mRing[head % capacity];
+    slot.seq.store(head * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.stats = mCurrent;
+    slot.seq.store(head * 2 + 2, std::memory_order_release);
+    mHead.store(head + 1, std::memory_order_release);
+}
+
+std::vector<TickStats> Profiler::recent(size_t num) const {
+    auto head = mHead.load(std::memory_order_acquire);
+    num = std::min({ num, static_cast<size_t>(head), static_cast<size_t>(capacity) });
+    std::vector<TickStats> res;
+    res.reserve(num);
+    //a slot the writer has moved on to holds a newer tick,it is skipped instead of retried.
+    for (auto i = head - static_cast<uint32_t>(num); i != head; ++i) {
+        auto&& slot = mRing[i % capacity];
+        auto seq = i * 2 + 2;
+        if (slot.seq.load(std::memory_order_acquire) != seq)continue;
+        TickStats stats = slot.stats;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) == seq)
+            res.emplace_back(stats);
+    }
+    return res;
+}
+
+const char* Profiler::getName(Phase phase) {
+    static const char* names[] = { "packet","flow","state","produce","unit","collision","bullet",
+        "visibility","owner","record","target","snapshot" };
+    static_assert(sizeof(names) / sizeof(names[0]) == phaseNum, "");
+    return names[static_cast<size_t>(phase)];
+}
+
+const char* Profiler::getName(Counter counter) {
+    static const char* names[] = { "units","bullets","pairs","snapshotBytes","stateBytes","duangBytes",
+        "otherBytes" };
+    static_assert(sizeof(names) / sizeof(names[0]) == counterNum, "");
+    return names[static_cast<size_t>(counter)];
+}
+
+bool Profiler::dumpCSV(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out)return false;
+    out << "tick";
+    for (size_t i = 0; i < phaseNum; ++i)
+        out << ',' << getName(static_cast<Phase>(i)) << "(ms)";
+    for (size_t i = 0; i < counterNum; ++i)
+        out << ',' << getName(static_cast<Counter>(i));
+    out << '\n';
+    for (auto&& t : recent(capacity)) {
+        out << t.tick;
+        for (auto x : t.time)
+            out << ',' << x;
+        for (auto x : t.count)
+            out << ',' << x;
+        out << '\n';
+    }
+    return static_cast<bool>(out);
+}
+
+bool Profiler::dumpTrace(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out)return false;
+    out << "{\"traceEvents\":[";
+    auto first = true;
+    auto event = [&](const char* name, const char* ph, double ts) {
+        out << (first ? "\n" : ",\n") << "{\"name\":\"" << name << "\",\"ph\":\"" << ph
+            << "\",\"pid\":0,\"tid\":0,\"ts\":" << ts;
+        first = false;
+    };
+    for (auto&& t : recent(capacity)) {
+        for (size_t i = 0; i < phaseNum; ++i)
+            if (t.time[i] > 0.0f) {
+                event(getName(static_cast<Phase>(i)), "X", t.start + t.begin[i] * 1000.0);
+                out << ",\"dur\":" << t.time[i] * 1000.0 << ",\"args\":{\"tick\":" << t.tick << "}}";
+            }
+        event("count", "C", t.start);
+        out << ",\"args\":{";
+        for (size_t i = 0; i < counterNum; ++i)
+            out << (i ? "," : "") << '"' << getName(static_cast<Counter>(i)) << "\":" << t.count[i];
+        out << "}}";
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "common.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+
+//the phases of a server tick in the order they run.
+enum class Phase : uint8_t {
+    packet, flow, state, produce, unit, collision, bullet, visibility, owner, record, target, snapshot,
+    phaseNum
+};
+
+enum class Counter : uint8_t {
+    units, bullets, pairs, snapshotBytes, stateBytes, duangBytes, otherBytes,
+    counterNum
+};
+
+constexpr auto phaseNum = static_cast<size_t>(Phase::phaseNum);
+constexpr auto counterNum = static_cast<size_t>(Counter::counterNum);
+
+struct TickStats final {
+    uint32_t tick;
+    //microseconds since the profiler was created.
+    double start;
+    //milliseconds,begin is relative to the start of the tick.
+    float begin[phaseNum], time[phaseNum];
+    uint32_t count[counterNum];
+};
+
+//one per simulation thread.the thread fills a tick and publishes it to a ring,
+//the others read the published ticks without locking.
+class Profiler final {
+public:
+    static constexpr auto capacity = 1024U;
+    using clock = std::chrono::steady_clock;
+private:
+    //seq is 2*i+1 while the i-th tick is written to the slot and 2*i+2 once it is complete,
+    //a reader drops the copy when seq is not the same before and after it.
+    struct Slot final {
+        std::atomic<uint32_t> seq;
+        TickStats stats;
+    };
+    std::array<Slot, capacity> mRing;
+    std::atomic<uint32_t> mHead;
+    TickStats mCurrent;
+    clock::time_point mOrigin, mStart, mLast;
+    float elapsed(clock::time_point from, clock::time_point to) const;
+public:
+    Profiler();
+    void begin(uint32_t tick);
+    //the time since the previous lap belongs to phase.
+    void lap(Phase phase);
+    void count(Counter counter, uint32_t num = 1);
+    void end();
+    //the latest num ticks,oldest first.
+    std::vector<TickStats> recent(size_t num) const;
+    static const char* getName(Phase phase);
+    static const char* getName(Counter counter);
+    bool dumpCSV(const std::string& path) const;
+    //the chrome://tracing format.
+    bool dumpTrace(const std::string& path) const;
+};
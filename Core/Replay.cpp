@@ -0,0 +1,274 @@
+#include "Replay.h"
+#include "Unit.h"
+#include "Bullet.h"
+
+namespace {
+    constexpr uint32_t magic = 0x524C4654;//TFLR
+    constexpr uint16_t version = 1;
+    //the writer thread wakes up when this much is queued.
+    constexpr auto bufferSize = 1U << 16;
+
+    void append(std::string& buffer, const void* data, size_t size) {
+        buffer.append(reinterpret_cast<const char*>(data), size);
+    }
+}
+
+void ReplayWriter::flush() {
+    std::string buffer;
+    auto stop = false;
+    while (!stop) {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mNotify.wait(lock, [this] {return mStop || mPending.size() >= bufferSize; });
+            buffer.swap(mPending);
+            stop = mStop;
+        }
+        mFile.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+    mFile.flush();
+}
+
+ReplayWriter::ReplayWriter(const std::string& path, const std::string& map)
+    :mFile(path, std::ios::binary), mStop(false), mCount(0) {
+    if (!mFile) {
+        INFO("Failed to create the replay ", path);
+        return;
+    }
+
+    RakNet::BitStream head;
+    head.Write(magic);
+    head.Write(version);
+    head.Write(pakKey);
+    head.Write(RakNet::RakString(map.c_str()));
+    //the ids of the kinds follow the order of the names.
+    head.Write(static_cast<uint16_t>(globalUnits.size()));
+    for (auto&& x : globalUnits)
+        head.Write(RakNet::RakString(x.first.c_str()));
+    head.Write(static_cast<uint16_t>(globalBullets.size()));
+    for (auto&& x : globalBullets)
+        head.Write(RakNet::RakString(x.first.c_str()));
+    uint32_t size = head.GetNumberOfBytesUsed();
+    append(mPending, &size, sizeof(size));
+    append(mPending, head.GetData(), size);
+
+    mThread = std::thread(&ReplayWriter::flush, this);
+}
+
+ReplayWriter::~ReplayWriter() {
+    if (!mThread.joinable())return;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mNotify.notify_one();
+    mThread.join();
+}
+
+void ReplayWriter::write(uint32_t time, Snapshot&& snapshot) {
+    if (!mThread.joinable())return;
+    uint8_t key = mCount % keyframeInterval == 0;
+    if (key)
+        mEncoder = SnapshotEncoder();
+    RakNet::BitStream data;
+    mEncoder.write(data, std::move(snapshot));
+    //the file never loses a record,so every record is the baseline of the next one.
+    mEncoder.ack(mCount % keyframeInterval + 1);
+    ++mCount;
+
+    uint32_t size = data.GetNumberOfBytesUsed();
+    bool full;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        append(mPending, &size, sizeof(size));
+        append(mPending, &time, sizeof(time));
+        append(mPending, &key, sizeof(key));
+        append(mPending, data.GetData(), size);
+        full = mPending.size() >= bufferSize;
+    }
+    if (full)
+        mNotify.notify_one();
+}
+
+bool ReplayPlayer::readRecord(size_t idx) {
+    auto&& r = mIndex[idx];
+    if (r.key)
+        mDecoder = SnapshotDecoder();
+    std::vector<unsigned char> buffer(r.size);
+    mFile.clear();
+    mFile.seekg(r.offset);
+    if (!mFile.read(reinterpret_cast<char*>(buffer.data()), r.size))return false;
+    RakNet::BitStream data(buffer.data(), r.size, false);
+    uint32_t seq;
+    const Snapshot* snapshot;
+    if (!mDecoder.read(data, seq, snapshot))return false;
+    mLatest = snapshot;
+    return true;
+}
+
+void ReplayPlayer::send(uint32_t time) {
+    if (!mLatest)return;
+    RakNet::BitStream data;
+    data.Write(ServerMessage::snapshot);
+    data.Write(time);
+    mEncoder.write(data, Snapshot(*mLatest));
+    mPeer->Send(&data, PacketPriority::HIGH_PRIORITY,
+        PacketReliability::UNRELIABLE_SEQUENCED, snapshotChannel, mClient, false);
+}
+
+ReplayPlayer::ReplayPlayer(const std::string& path) :mFile(path, std::ios::binary),
+    mPeer(RakNet::RakPeerInterface::GetInstance()), mClient(RakNet::UNASSIGNED_SYSTEM_ADDRESS),
+    mLatest(nullptr), mNext(0), mTime(0.0), mClock(0.0), mSpeed(1.0f) {
+    RakNet::SocketDescriptor SD(23333, nullptr);
+    mPeer->Startup(1, &SD, 1);
+    mPeer->SetMaximumIncomingConnections(1);
+
+    uint32_t size;
+    if (!mFile.read(reinterpret_cast<char*>(&size), sizeof(size))) {
+        INFO("Failed to open the replay ", path);
+        return;
+    }
+    std::vector<unsigned char> buffer(size);
+    mFile.read(reinterpret_cast<char*>(buffer.data()), size);
+    RakNet::BitStream head(buffer.data(), size, false);
+    uint32_t m;
+    uint16_t v;
+    uint64_t key;
+    RakNet::RakString str;
+    if (!head.Read(m) || m != magic || !head.Read(v) || v != version || !head.Read(key) || !head.Read(str)) {
+        INFO("The replay ", path, " is broken.");
+        return;
+    }
+    if (key != pakKey) {
+        INFO("The replay ", path, " was recorded with other paks.");
+        return;
+    }
+    mMap = str.C_String();
+
+    //the kinds are sent by id,so the tables must be the same.
+    auto check = [&](auto&& kinds) {
+        uint16_t num;
+        if (!head.Read(num) || num != kinds.size())return false;
+        for (auto&& x : kinds)
+            if (!head.Read(str) || x.first != str.C_String())return false;
+        return true;
+    };
+    if (!check(globalUnits) || !check(globalBullets)) {
+        INFO("The kinds of the replay ", path, " are different from yours.");
+        return;
+    }
+
+    Record r;
+    while (mFile.read(reinterpret_cast<char*>(&r.size), sizeof(r.size))
+        && mFile.read(reinterpret_cast<char*>(&r.time), sizeof(r.time))) {
+        uint8_t k;
+        if (!mFile.read(reinterpret_cast<char*>(&k), sizeof(k)))break;
+        r.key = k;
+        r.offset = mFile.tellg();
+        if (!mFile.seekg(r.size, std::ios::cur))break;
+        mIndex.emplace_back(r);
+    }
+    //a replay begins with a keyframe,the records after a cut are useless.
+    if (mIndex.size() && !mIndex.front().key)
+        mIndex.clear();
+    INFO("Loaded the replay ", path, " (", mIndex.size(), " records)");
+}
+
+ReplayPlayer::~ReplayPlayer() {
+    if (mClient != RakNet::UNASSIGNED_SYSTEM_ADDRESS) {
+        RakNet::BitStream data;
+        data.Write(ServerMessage::stop);
+        mPeer->Send(&data, PacketPriority::IMMEDIATE_PRIORITY,
+            PacketReliability::RELIABLE_ORDERED, 0, mClient, false);
+    }
+    mPeer->Shutdown(500, 0, PacketPriority::IMMEDIATE_PRIORITY);
+    RakNet::RakPeerInterface::DestroyInstance(mPeer);
+}
+
+bool ReplayPlayer::isValid() const {
+    return mIndex.size();
+}
+
+bool ReplayPlayer::waitClient() {
+    for (auto packet = mPeer->Receive(); packet; mPeer->DeallocatePacket(packet), packet = mPeer->Receive()) {
+        CheckBegin;
+        CheckHeader(ID_NEW_INCOMING_CONNECTION) {
+            mClient = packet->systemAddress;
+            INFO("A client has connected this replay.", "(IP=", mClient.ToString(), ")");
+            RakNet::BitStream info;
+            info.Write(ServerMessage::info);
+            info.Write(pakKey);
+            info.Write(mMap.c_str());
+            mPeer->Send(&info, IMMEDIATE_PRIORITY, RELIABLE_ORDERED, 0, mClient, false);
+            changeSpeed(mSpeed);
+            RakNet::BitStream go;
+            go.Write(ServerMessage::go);
+            go.Write(Vector2::zero());
+            mPeer->Send(&go, IMMEDIATE_PRIORITY, RELIABLE_ORDERED, 0, mClient, false);
+        }
+    }
+    return mClient != RakNet::UNASSIGNED_SYSTEM_ADDRESS;
+}
+
+bool ReplayPlayer::update(float delta) {
+    for (auto packet = mPeer->Receive(); packet; mPeer->DeallocatePacket(packet), packet = mPeer->Receive()) {
+        RakNet::BitStream data(packet->data, packet->length, false);
+        data.IgnoreBytes(1);
+        CheckBegin;
+        CheckHeader(ID_DISCONNECTION_NOTIFICATION) {
+            mClient = RakNet::UNASSIGNED_SYSTEM_ADDRESS;
+        }
+        CheckHeader(ClientMessage::exit) {
+            mClient = RakNet::UNASSIGNED_SYSTEM_ADDRESS;
+        }
+        CheckHeader(ClientMessage::ack) {
+            uint32_t seq;
+            if (data.Read(seq))
+                mEncoder.ack(seq);
+        }
+    }
+    if (mClient == RakNet::UNASSIGNED_SYSTEM_ADDRESS)return false;
+
+    //the client interpolates in its own time,the replay time runs mSpeed times faster.
+    mClock += delta;
+    mTime += delta*mSpeed;
+    auto read = false;
+    while (mNext < mIndex.size() && mIndex[mNext].time <= mTime) {
+        if (!readRecord(mNext)) {
+            INFO("Failed to read the record at ", mIndex[mNext].time, "ms.");
+            return false;
+        }
+        ++mNext, read = true;
+    }
+    if (read)
+        send(static_cast<uint32_t>(mClock));
+    return mNext < mIndex.size();
+}
+
+bool ReplayPlayer::seek(uint32_t time) {
+    size_t begin = 0, end = 0;
+    for (size_t i = 0; i < mIndex.size() && mIndex[i].time <= time; ++i) {
+        if (mIndex[i].key)
+            begin = i;
+        end = i + 1;
+    }
+    //the records after a broken one are encoded against it.
+    for (auto i = begin; i < end; ++i)
+        if (!readRecord(i)) {
+            INFO("Failed to read the record at ", mIndex[i].time, "ms.");
+            return false;
+        }
+    mNext = end;
+    mTime = time;
+    return true;
+}
+
+void ReplayPlayer::changeSpeed(float speed) {
+    mSpeed = speed;
+    if (mClient == RakNet::UNASSIGNED_SYSTEM_ADDRESS)return;
+    RakNet::BitStream data;
+    data.Write(ServerMessage::changeSpeed);
+    data.Write(mSpeed);
+    mPeer->Send(&data, PacketPriority::IMMEDIATE_PRIORITY,
+        PacketReliability::RELIABLE_ORDERED, 0, mClient, false);
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "common.h"
+#include "Snapshot.h"
+#include <RakPeer.h>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//a replay is a header with the map and the names of the kinds,followed by the records.
+//a record is a snapshot of the whole world encoded against the previous record,
+//every keyframeInterval records it is encoded against nothing so that playback can start there.
+constexpr auto keyframeInterval = 200U;
+
+//the records are queued by the simulation thread and written by a thread of its own.
+class ReplayWriter final {
+private:
+    std::ofstream mFile;
+    std::thread mThread;
+    std::mutex mMutex;
+    std::condition_variable mNotify;
+    std::string mPending;
+    bool mStop;
+    SnapshotEncoder mEncoder;
+    uint32_t mCount;
+    void flush();
+public:
+    ReplayWriter(const std::string& path, const std::string& map);
+    ~ReplayWriter();
+    void write(uint32_t time, Snapshot&& snapshot);
+};
+
+//serves a replay to one client as if it was a server,at any speed and from any time.
+class ReplayPlayer final {
+private:
+    struct Record final {
+        uint32_t time;
+        bool key;
+        std::streamoff offset;
+        uint32_t size;
+    };
+    std::ifstream mFile;
+    std::string mMap;
+    std::vector<Record> mIndex;
+    RakNet::RakPeerInterface* mPeer;
+    RakNet::SystemAddress mClient;
+    SnapshotDecoder mDecoder;
+    SnapshotEncoder mEncoder;
+    const Snapshot* mLatest;
+    size_t mNext;
+    double mTime, mClock;
+    float mSpeed;
+    bool readRecord(size_t idx);
+    void send(uint32_t time);
+public:
+    explicit ReplayPlayer(const std::string& path);
+    ~ReplayPlayer();
+    bool isValid() const;
+    bool waitClient();
+    //delta is in real milliseconds,returns false at the end of the replay or on a broken record.
+    bool update(float delta);
+    //decodes from the last keyframe before time,the client jumps there with the next snapshot.
+    //returns false at the first record that can't be read.
+    bool seek(uint32_t time);
+    void changeSpeed(float speed);
+};
@@ -1,14 +1,53 @@
 #include "Server.h"
 #include "Message.h"
-#include <functional>
+#include <chrono>
+#include <unordered_set>
 
 std::unique_ptr<Server> localServer;
 
+namespace {
+    //the wall clock for the time budget of the collisions,the simulation runs on mNow.
+    double getTime() {
+        using namespace std::chrono;
+        static const auto begin = steady_clock::now();
+        return duration<double, std::milli>(steady_clock::now() - begin).count();
+    }
+}
+
 void Server::send(uint8_t group, const RakNet::BitStream & data, PacketPriority priority) {
+    auto counter = data.GetData()[0] == static_cast<unsigned char>(ServerMessage::duang) ?
+        Counter::duangBytes : Counter::otherBytes;
     for (auto&& c : mClients)
-        if (c.second.group == group)
+        if (c.second.group == group) {
             mPeer->Send(&data, priority,
                 PacketReliability::RELIABLE_ORDERED, 0, c.first, false);
+            mProfiler.count(counter, data.GetNumberOfBytesUsed());
+        }
+}
+
+void Server::sendStats(const RakNet::SystemAddress& client) {
+    //the average and the worst of the last second.
+    auto ticks = mProfiler.recent(tickRate);
+    float avg[phaseNum]{}, max[phaseNum]{}, count[counterNum]{};
+    for (auto&& t : ticks) {
+        for (size_t i = 0; i < phaseNum; ++i) {
+            avg[i] += t.time[i];
+            max[i] = std::max(max[i], t.time[i]);
+        }
+        for (size_t i = 0; i < counterNum; ++i)
+            count[i] += t.count[i];
+    }
+    RakNet::BitStream data;
+    data.Write(ServerMessage::stats);
+    data.Write(static_cast<uint16_t>(ticks.size()));
+    auto num = std::max(ticks.size(), static_cast<size_t>(1));
+    for (size_t i = 0; i < phaseNum; ++i) {
+        data.Write(avg[i] / num);
+        data.Write(max[i]);
+    }
+    for (size_t i = 0; i < counterNum; ++i)
+        data.Write(count[i] / num);
+    mPeer->Send(&data, PacketPriority::LOW_PRIORITY, PacketReliability::RELIABLE_ORDERED, 0, client, false);
 }
 
 void Server::chooseNew(KeyInfo& k) {
@@ -25,24 +64,72 @@ void Server::chooseNew(KeyInfo& k) {
 
     k.id = (idx == w.size()) ? 0 : idx;
     if (k.time)
-        k.time += getUnit(k.id).getTime() / mSpeed;
+        k.time += getUnit(k.id).getTime();
     else
-        k.time = Game::getAbsoluteTime();
+        k.time = mNow;
 }
 
 Server::Server(const std::string & path) :
     mPeer(RakNet::RakPeerInterface::GetInstance()), mState(false),
-    mMap(path), mMapName(path), mSpeed(1.0f) {
+    mMap(path), mMapName(path), mSpeed(1.0f), mTick(0), mNow(0.0),
+    mSeed(std::chrono::steady_clock::now().time_since_epoch().count()), mDeterministic(false), mRunning(false), mInbox(nullptr) {
     RakNet::SocketDescriptor SD(23333, nullptr);
     mPeer->Startup(16, &SD, 1);
     mPeer->SetMaximumIncomingConnections(16);
 }
 
 Server::~Server() {
+    stop();
+    runCommands();
     mPeer->Shutdown(500, 0, PacketPriority::IMMEDIATE_PRIORITY);
     RakNet::RakPeerInterface::DestroyInstance(mPeer);
 }
 
+void Server::post(std::function<void()> func) {
+    auto command = new Command{ std::move(func),mInbox.load(std::memory_order_relaxed) };
+    while (!mInbox.compare_exchange_weak(command->next, command,
+        std::memory_order_release, std::memory_order_relaxed));
+}
+
+void Server::runCommands() {
+    //the inbox is a stack,reverse it to run the commands in the posted order.
+    Command* list = nullptr;
+    for (auto c = mInbox.exchange(nullptr, std::memory_order_acquire); c;) {
+        auto next = c->next;
+        c->next = list;
+        list = c;
+        c = next;
+    }
+    while (list) {
+        std::unique_ptr<Command> c(list);
+        list = c->next;
+        c->func();
+    }
+}
+
+void Server::loop() {
+    using clock = std::chrono::steady_clock;
+    constexpr auto step = std::chrono::duration_cast<clock::duration>(std::chrono::seconds(1)) / tickRate;
+    constexpr auto delta = 1000.0f / tickRate;
+    auto next = clock::now();
+    //mt is thread local,the simulation thread seeds its own one.
+    mt.seed(mSeed);
+    while (mRunning && mState) {
+        runCommands();
+        update(delta);
+        next += step;
+        //drop the lost ticks instead of catching up forever when the host is too slow.
+        auto now = clock::now();
+        if (now - next > step * 5)
+            next = now;
+        std::this_thread::sleep_until(next);
+    }
+    //the bullets go back to the pools of this thread,which are dropped before the thread ends.
+    mBullets.clear();
+    clearBulletPools();
+    mRunning = false;
+}
+
 void Server::waitClient() {
     for (auto packet = mPeer->Receive(); packet; mPeer->DeallocatePacket(packet), packet = mPeer->Receive()) {
         RakNet::BitStream data(packet->data, packet->length, false);
@@ -96,7 +183,15 @@ const std::map<RakNet::SystemAddress, ClientInfo>& Server::getClientInfo() {
 
 void Server::run() {
     mScene = Scene::create();
+#ifndef TFL_HEADLESS
     mMap.set(mScene->addNode("terrain"));
+#endif // !TFL_HEADLESS
+
+    //the simulation only moves the skeletons,they are loaded here so the first tick does not wait for the files.
+    for (auto&& x : globalUnits)
+        uniqueRAII<Node> model = x.second.getSkeleton();
+    for (auto&& x : globalBullets)
+        uniqueRAII<Node> model = x.second.getModel(true);
 
     for (auto&& x : mMap.getKey())
         mKey.emplace_back(x);
@@ -105,7 +200,11 @@ void Server::run() {
     for (auto&& x : mClients)
         flag[x.second.group] = true;
 
-    auto time = Game::getAbsoluteTime() + getUnit(0).getTime() / mSpeed;
+    //ids and random numbers restart with every match.
+    UnitInstance::resetID();
+    BulletInstance::resetID();
+    mt.seed(mSeed);
+    auto time = mNow + getUnit(0).getTime();
 
     for (uint8_t i = 1; i <= 5; ++i)
         if (flag[i]) {
@@ -125,7 +224,9 @@ void Server::run() {
     waitClient();
     getClientInfo();
 
+    uint8_t phase = 0;
     for (auto&& x : mClients) {
+        x.second.phase = phase++ % snapshotInterval;
         RakNet::BitStream data;
         data.Write(ServerMessage::go);
         data.Write(mKey[mGroups[x.second.group].key.front()].pos);
@@ -133,6 +234,8 @@ void Server::run() {
     }
 
     mState = true;
+    mRunning = true;
+    mThread = std::thread(&Server::loop, this);
 }
 
 void Server::update(float delta) {
@@ -141,10 +244,13 @@ void Server::update(float delta) {
 
     if (!mState)return;
 
+    mNow += delta;
+    mProfiler.begin(mTick);
+
     getClientInfo();
 
     if (mGroups.empty()) {
-        stop();
+        finish();
         return;
     }
 
@@ -154,6 +260,14 @@ void Server::update(float delta) {
         data.IgnoreBytes(1);
         auto group = mClients[packet->systemAddress].group;
         auto& units = mGroups[group].units;
+        if (mCommands.is_open() && packet->data[0] != static_cast<unsigned char>(ClientMessage::ack)
+            && packet->data[0] != static_cast<unsigned char>(ClientMessage::stats)) {
+            uint32_t size = packet->length;
+            mCommands.write(reinterpret_cast<const char*>(&mTick), sizeof(mTick));
+            mCommands.write(reinterpret_cast<const char*>(&group), sizeof(group));
+            mCommands.write(reinterpret_cast<const char*>(&size), sizeof(size));
+            mCommands.write(reinterpret_cast<const char*>(packet->data), size);
+        }
         CheckBegin;
         CheckHeader(ID_DISCONNECTION_NOTIFICATION) {
             INFO("Client ", packet->systemAddress.ToString(), " disconnected.");
@@ -197,7 +311,7 @@ void Server::update(float delta) {
                 auto u = units.find(id);
                 if (u != units.cend()) {
                     u->second.setMoveTarget(pos);
-                    if (u->second.getKind().getType() == "base") {
+                    if (u->second.getKind().getUnitType() == UnitType::base) {
                         if (u->second.getAttackTarget() == pointID)
                             u->second.setAttackTarget(0);
                         else
@@ -241,55 +355,26 @@ void Server::update(float delta) {
             if (it != units.cend())
                 releaseUnit(it->second);
         }
-    }
-
-    //check owner
-    {
-        uint8_t idx = 0;
-        for (auto&& k : mKey) {
-            std::map<uint8_t, float> dis;
-            for (auto&& g : mGroups) {
-                auto minDis = std::numeric_limits<float>::max();
-                for (auto&& u : g.second.units) {
-                    if (std::find_if(mDeferred.cbegin(), mDeferred.cend(), [&u](auto&& x) {
-                        return x.id == u.first;
-                    }) != mDeferred.cend())continue;
-                    auto p = u.second.getNode()->getTranslation();
-                    minDis = std::min(minDis, k.pos.distanceSquared({ p.x,p.z }));
-                }
-                dis[g.first] = minDis;
-            }
-            auto cnt = std::count_if(dis.cbegin(), dis.cend(), [](auto p) {return p.second < 40000.0f; });
-
-            if (cnt == 1) {
-                auto min = std::min_element(dis.cbegin(), dis.cend(),
-                    [](auto p1, auto p2) {return p1.second < p2.second; });
-                if (k.owner != KeyInfo::nil) {
-                    if (k.owner != min->first) {
-                        auto& old = mGroups[k.owner].key;
-                        old.erase(std::find(old.cbegin(), old.cend(), idx));
-                        k.owner = min->first;
-                        mGroups[k.owner].key.emplace_back(idx);
-                    }
-                }
-                else {
-                    k.owner = min->first;
-                    mGroups[k.owner].key.emplace_back(idx);
-                }
-
-                if (k.id == KeyInfo::none)
-                    chooseNew(k);
-            }
-            ++idx;
+        CheckHeader(ClientMessage::ack) {
+            uint32_t seq;
+            if (data.Read(seq))
+                mClients[packet->systemAddress].snapshot.ack(seq);
+        }
+        CheckHeader(ClientMessage::stats) {
+            sendStats(packet->systemAddress);
         }
     }
+    mProfiler.lap(Phase::packet);
+
+    mMap.updateFlow();
+    mProfiler.lap(Phase::flow);
 
     //check state
     auto win = [this](uint8_t group) {
         RakNet::BitStream data;
         data.Write(ServerMessage::win);
         send(group, data, PacketPriority::IMMEDIATE_PRIORITY);
-        stop();
+        finish();
     };
 
     uint8_t out = 0;
@@ -313,14 +398,15 @@ void Server::update(float delta) {
                 return;
             }
 
+    mProfiler.lap(Phase::state);
+
     //produce unit
-    auto now = Game::getAbsoluteTime();
     bool flag;
     std::uniform_real_distribution<float> dis(-100.0f, 100.0f);
     do {
         flag = false;
         for (auto&& k : mKey) {
-            if (k.owner != KeyInfo::nil && Game::getAbsoluteTime() > k.time) {
+            if (k.owner != KeyInfo::nil && mNow > k.time) {
                 auto pos = Vector2{ k.pos.x + dis(mt),k.pos.y + dis(mt) };
                 Vector3 p(pos.x, mMap.getHeight(pos.x, pos.y) + 10.0f, pos.y);
                 auto id = UnitInstance::askID();
@@ -335,7 +421,26 @@ void Server::update(float delta) {
     } while (flag);
 
     {
-        //shuffle groups to make the game blance.
+        auto now = mNow;
+        mDeferred.erase(std::remove_if(mDeferred.begin(), mDeferred.end(),
+            [this, now](const DiedInfo& x) {
+            if (now - x.time > corpseTime) {
+                auto& units = mGroups[x.group].units;
+                auto i = units.find(x.id);
+                if (i != units.cend()) {
+                    mScene->removeNode(i->second.getNode());
+                    mGroups[x.group].units.erase(i);
+                }
+                return true;
+            }
+            return false;
+        }), mDeferred.end());
+    }
+
+    mProfiler.lap(Phase::produce);
+
+    {
+        //shuffle groups to make the game blance,then batch the units by kind.
         std::vector<CheckInfo> units;
 
         for (auto&& x : mGroups)
@@ -343,47 +448,47 @@ void Server::update(float delta) {
                 units.push_back({ u.first,x.first,&u.second });
 
         std::shuffle(units.begin(), units.end(), mt);
-
-        for (auto&& u : units) {
-            if (u.instance->isStoped() && u.instance->getLoadTarget()) {
-                auto&& units = mGroups[u.group].units;
-                auto x = units.find(u.instance->getLoadTarget());
+        std::stable_sort(units.begin(), units.end(), [](const CheckInfo& lhs, const CheckInfo& rhs) {
+            return lhs.instance->getKind().getID() < rhs.instance->getKind().getID();
+        });
+
+        //the units released in this loop are updated in the next tick.
+        for (auto&& c : units) {
+            auto u = c.instance;
+            if (u->isStoped() && u->getLoadTarget()) {
+                auto&& units = mGroups[c.group].units;
+                auto x = units.find(u->getLoadTarget());
                 if (x != units.cend() && x->second.getLoadSize() < x->second.getKind().getLoading()) {
                     auto p = x->second.getRoughPos();
-                    u.instance->setMoveTarget({ p.x,p.z });
+                    u->setMoveTarget({ p.x,p.z });
                 }
-                else u.instance->setLoadTarget(0);
+                else u->setLoadTarget(0);
             }
 
-            if (u.instance->update(delta) || u.instance->isDied())
-                mCheck.insert(u);
+            if (u->update(delta) || u->isDied())
+                mCheck.insert(c);
         }
-    }
 
-    {
-        auto now = Game::getAbsoluteTime();
-        mDeferred.erase(std::remove_if(mDeferred.begin(), mDeferred.end(),
-            [this, now](const DiedInfo& x) {
-            if (now - x.time > 5000.0) {
-                auto& units = mGroups[x.group].units;
-                auto i = units.find(x.id);
-                if (i != units.cend()) {
-                    mScene->removeNode(i->second.getNode());
-                    mGroups[x.group].units.erase(i);
-                }
-                return true;
-            }
-            return false;
-        }), mDeferred.end());
+        mProfiler.count(Counter::units, units.size());
     }
 
+    mProfiler.lap(Phase::unit);
+
     std::set<CheckInfo> newCheck;
     auto test = [&](uint32_t id) {
         return std::find_if(mDeferred.cbegin(), mDeferred.cend(),
             [id](auto&& x) {return x.id == id; }) == mDeferred.cend();
     };
 
-    now = Game::getAbsoluteTime();
+    auto begin = getTime();
+    auto pass = 0;
+
+    mUnitGrid.clear();
+    for (auto&& g : mGroups)
+        for (auto&& u : g.second.units)
+            mUnitGrid.insert(u.first, &u.second, u.second.getBound());
+
+    std::vector<CheckInfo> moved;
 
     do {
         if (newCheck.size()) {
@@ -394,34 +499,35 @@ void Server::update(float delta) {
         for (auto&& c : mCheck)
             if (mGroups[c.group].units.find(c.id) != mGroups[c.group].units.cend()) {
                 auto bs1 = c.instance->getBound();
-                for (auto&& x : mGroups)
-                    for (auto&& u : x.second.units)
-                        if (c.id != u.first) {
-                            auto bs2 = u.second.getBound();
-                            if (bs1.intersects(bs2)) {
-                                if (c.group == x.first && test(u.first) && test(c.id) &&
-                                    ((c.instance->getLoadTarget() == u.first && u.second.tryLoad(*c.instance)) ||
-                                    (u.second.getLoadTarget() == c.id && c.instance->tryLoad(u.second)))) {
-                                    if (c.instance->getLoadTarget() == u.first)
-                                        mDeferred.push_back({ c.group, c.id,0.0f });
-                                    else
-                                        mDeferred.push_back({ u.second.getGroup(), u.first,0.0f });
-                                }
-                                else {
-                                    auto v = bs1.center - bs2.center;
-                                    v.y = 0.0f;
-                                    v.normalize();
-                                    v *= bs1.radius + bs2.radius - bs1.center.distance(bs2.center);
-                                    v *= 1.3f;
-                                    auto cube = [](float x) {return x*x*x; };
-                                    auto ss = cube(bs1.radius) + cube(bs2.radius);
-                                    c.instance->getNode()->translate(v*cube(bs2.radius) / ss);
-                                    u.second.getNode()->translate(-v*cube(bs1.radius) / ss);
-                                    newCheck.insert(c);
-                                    newCheck.insert({ u.first,x.first,&u.second });
-                                }
-                            }
-                        }
+                mUnitGrid.query(bs1, [&](uint32_t id, UnitInstance* u, const BoundingSphere&) {
+                    if (c.id == id)return;
+                    mProfiler.count(Counter::pairs);
+                    auto bs2 = u->getBound();
+                    if (!bs1.intersects(bs2))return;
+                    if (c.group == u->getGroup() && test(id) && test(c.id) &&
+                        ((c.instance->getLoadTarget() == id && u->tryLoad(*c.instance)) ||
+                        (u->getLoadTarget() == c.id && c.instance->tryLoad(*u)))) {
+                        if (c.instance->getLoadTarget() == id)
+                            mDeferred.push_back({ c.group, c.id,mNow - corpseTime });
+                        else
+                            mDeferred.push_back({ u->getGroup(), id,mNow - corpseTime });
+                    }
+                    else {
+                        auto v = bs1.center - bs2.center;
+                        v.y = 0.0f;
+                        v.normalize();
+                        v *= bs1.radius + bs2.radius - bs1.center.distance(bs2.center);
+                        v *= 1.3f;
+                        auto cube = [](float x) {return x*x*x; };
+                        auto ss = cube(bs1.radius) + cube(bs2.radius);
+                        c.instance->getNode()->translate(v*cube(bs2.radius) / ss);
+                        u->getNode()->translate(-v*cube(bs1.radius) / ss);
+                        newCheck.insert(c);
+                        newCheck.insert({ id,u->getGroup(),u });
+                        moved.push_back(c);
+                        moved.push_back({ id,u->getGroup(),u });
+                    }
+                });
                 for (auto&& x : mMap.getKey()) {
                     Vector3 p{ x.x,mMap.getHeight(x.x,x.y),x.y };
                     BoundingSphere bs2{ p,5.0f };
@@ -433,80 +539,80 @@ void Server::update(float delta) {
                         v *= 1.3f;
                         c.instance->getNode()->translate(v);
                         newCheck.insert(c);
+                        moved.push_back(c);
                     }
                 }
+
+                for (auto&& m : moved)
+                    mUnitGrid.update(m.id, m.instance->getBound());
+                moved.clear();
             }
-    } while (newCheck.size() && Game::getAbsoluteTime() - now <= 10.0);
+    } while (newCheck.size() && (mDeterministic ? ++pass < maxCollisionPass : getTime() - begin <= 10.0));
 
     if (newCheck.size()) {
         mCheck.swap(newCheck);
         newCheck.clear();
     }
 
+    mProfiler.lap(Phase::collision);
+
     {
         std::map<uint8_t, std::set<uint32_t>> duang;
         std::map<uint32_t, DuangSyncInfo> info;
         std::set<uint32_t> deferred;
-        std::vector < std::pair<uint8_t, BoundingSphere>> vbs;
 
+        mHitGrid.clear();
         for (auto&& x : mBullets) {
             x.second.update(delta);
-            vbs.emplace_back(x.second.getGroup(), x.second.getHitBound());
+            mHitGrid.insert(x.first, x.second.getGroup(), x.second.getHitBound());
         }
 
-        size_t idx = 0;
+        std::set<uint32_t> died;
+        for (auto&& x : mDeferred)
+            died.insert(x.id);
+
         for (auto&& x : mBullets) {
-            auto bb = vbs[idx].second;
+            auto bb = x.second.getHitBound();
             if (bb.center.x<-mapSizeHF || bb.center.x>mapSizeHF
                 || bb.center.z<-mapSizeHF || bb.center.z>mapSizeHF) {
                 deferred.insert(x.first);
-                ++idx;
                 continue;
             }
 
+            auto group = x.second.getGroup();
             bool boom = false;
-            for (auto&& g : mGroups)
-                for (auto&& u : g.second.units)
-                    if (u.second.getGroup() != x.second.getGroup() && bb.intersects(u.second.getBound())) {
-                        boom = true;
-                        goto point;
-                    }
-            for (auto&& x : mDeferred) {
-                auto iter = mGroups[x.group].units.find(x.id);
-                if (iter != mGroups[x.group].units.end() && iter->second.getBound().intersects(bb)) {
+            mUnitGrid.query(bb, [&](uint32_t id, UnitInstance* u, const BoundingSphere&) {
+                if (!boom && (u->getGroup() != group || died.find(id) != died.cend())
+                    && bb.intersects(u->getBound()))
                     boom = true;
-                    goto point;
-                }
-            }
+            });
 
-            for (size_t i = 0; i < vbs.size(); ++i)
-                if (vbs[i].first != vbs[idx].first && vbs[i].second.intersects(bb)) {
-                    boom = true;
-                    goto point;
-                }
+            if (!boom)
+                mHitGrid.query(bb, [&](uint32_t, uint8_t g, const BoundingSphere& bs) {
+                    if (!boom && g != group && bs.intersects(bb))
+                        boom = true;
+                });
 
-            if ((bb.center.y - bb.radius < mMap.getHeight(bb.center.x, bb.center.z)))
+            if (!boom && (bb.center.y - bb.radius < mMap.getHeight(bb.center.x, bb.center.z)))
                 boom = true;
 
-        point:
             if (boom) {
                 auto b = x.second.getBound();
-                for (auto&& g : mGroups)
-                    for (auto&& u : g.second.units) {
-                        auto bu = u.second.getBound();
-                        if (x.second.getGroup() != u.second.getGroup() && b.intersects(bu)) {
-                            auto dis = b.center.distance(bu.center);
-                            auto fac = (dis - bu.radius) / b.radius;
-                            fac = std::max(fac, 0.0f);
-                            attack(u.first, x.second.getHarm()*(1.0f - fac*fac));
-                        }
-                        if (b.center.distanceSquared(bu.center) < u.second.getKind().getFOV())
-                            duang[g.first].insert(x.first);
+                mUnitGrid.query(b, [&](uint32_t id, UnitInstance* u, const BoundingSphere&) {
+                    auto bu = u->getBound();
+                    if (group != u->getGroup() && b.intersects(bu)) {
+                        auto dis = b.center.distance(bu.center);
+                        auto fac = (dis - bu.radius) / b.radius;
+                        fac = std::max(fac, 0.0f);
+                        attack(id, x.second.getHarm()*(1.0f - fac*fac));
                     }
+                });
+                for (auto&& g : mGroups)
+                    if (mVisibility.isVisible(g.first, b.center))
+                        duang[g.first].insert(x.first);
                 deferred.insert(x.first);
                 info[x.first] = { x.second.getKind(), b.center };
             }
-            ++idx;
         }
 
         for (auto&& x : duang) {
@@ -522,109 +628,202 @@ void Server::update(float delta) {
             mScene->removeNode(mBullets[x].getNode());
             mBullets.erase(x);
         }
+
+        mBulletGrid.clear();
+        for (auto&& x : mBullets)
+            mBulletGrid.insert(x.first, x.second.getGroup(), x.second.getBound());
     }
 
-    std::vector<uint8_t> groups;
-    for (auto c : mClients)
-        groups.emplace_back(c.second.group);
-    uint8_t gid = mt() % groups.size();
-    uint8_t choose = groups[gid];
-    GroupInfo& update = mGroups[choose];
+    mProfiler.lap(Phase::bullet);
+    mProfiler.count(Counter::bullets, mBullets.size());
+
+    //visibility
+    //the units that died are dropped from the coverage of their group by finish.
+    for (auto&& g : mGroups)
+        for (auto&& u : g.second.units) {
+            if (u.second.isDied())continue;
+            auto&& kind = u.second.getKind();
+            mVisibility.update(u.first, g.first, u.second.getNode()->getTranslation(),
+                std::sqrt(kind.getFOV()), std::sqrt(kind.getSound()));
+        }
+    mVisibility.finish();
 
-    //update unit
-    std::vector<UnitSyncInfo> saw;
+    mSight.clear();
     for (auto&& g : mGroups)
         for (auto&& u : g.second.units) {
+            if (u.second.isDied())continue;
             auto p = u.second.getNode()->getTranslation();
-            for (auto&& mu : update.units)
-                if ((g.first == mu.second.getGroup() && !u.second.isDied()) ||
-                    (!mu.second.isDied() && p.distanceSquared(mu.second.getNode()->getTranslation())
-                        <= (p.y >= 0.0f ? mu.second.getKind().getFOV() : mu.second.getKind().getSound()))) {
-                    uint16_t uk = getUnitID(u.second.getKind().getName());
-                    saw.push_back({ u.first,uk,p,u.second.getNode()->getRotation(),
-                        g.first,u.second.getAttackTarget(),u.second.getAttackPos(),
-                        g.first == mu.second.getGroup() ? u.second.getLoadSize() : 0
-                        ,u.second.getHP() });
-                    break;
+            for (auto&& o : mGroups)
+                if (o.first != g.first && mVisibility.isVisible(o.first, p)) {
+                    auto res = mSight.insert({ o.first,{ { p.x,p.z },{ p.x,p.z } } });
+                    if (!res.second)
+                        res.first->second.merge(p);
                 }
         }
+    mProfiler.lap(Phase::visibility);
 
+    //check owner
+    //a key belongs to the only group with a living unit around it,the grid holds the positions of this tick.
     {
-        RakNet::BitStream data;
-        data.Write(ServerMessage::updateUnit);
-        data.Write(static_cast<uint32_t>(saw.size()));
-        for (auto&& u : saw)
-            data.Write(u);
-
-        send(choose, data, PacketPriority::HIGH_PRIORITY);
-    }
+        std::unordered_set<uint32_t> deferred;
+        for (auto&& x : mDeferred)
+            deferred.insert(x.id);
+        uint8_t idx = 0;
+        for (auto&& k : mKey) {
+            std::set<uint8_t> near;
+            mUnitGrid.query(Vector3{ k.pos.x,0.0f,k.pos.y }, KeyInfo::radius,
+                [&](uint32_t id, UnitInstance* u, const BoundingSphere& bs) {
+                if (deferred.find(id) != deferred.cend())return;
+                if (k.pos.distanceSquared({ bs.center.x,bs.center.z }) < KeyInfo::radius*KeyInfo::radius)
+                    near.insert(u->getGroup());
+            });
+
+            if (near.size() == 1) {
+                auto owner = *near.begin();
+                if (k.owner != KeyInfo::nil) {
+                    if (k.owner != owner) {
+                        auto& old = mGroups[k.owner].key;
+                        old.erase(std::find(old.cbegin(), old.cend(), idx));
+                        k.owner = owner;
+                        mGroups[k.owner].key.emplace_back(idx);
+                    }
+                }
+                else {
+                    k.owner = owner;
+                    mGroups[k.owner].key.emplace_back(idx);
+                }
 
-    //update bullet
-    std::vector<BulletSyncInfo> bullets;
-    for (auto&& b : mBullets) {
-        auto p = b.second.getBound().center;
-        for (auto&& mu : update.units)
-            if ((b.second.getGroup() == mu.second.getGroup()) ||
-                (!mu.second.isDied() && p.distanceSquared(mu.second.getNode()->getTranslation())
-                    <= (p.y >= 0.0f ? mu.second.getKind().getFOV() : mu.second.getKind().getSound()))) {
-                bullets.push_back({ b.first,b.second.getKind(),p,b.second.getNode()->getRotation() });
-                break;
+                if (k.id == KeyInfo::none)
+                    chooseNew(k);
             }
+            ++idx;
+        }
     }
 
-    {
-        RakNet::BitStream data;
-        data.Write(ServerMessage::updateBullet);
-        data.Write(static_cast<uint32_t>(bullets.size()));
-        for (auto&& b : bullets)
-            data.Write(b);
-        send(choose, data, PacketPriority::HIGH_PRIORITY);
+    mProfiler.lap(Phase::owner);
+
+    //every client gets a snapshot each snapshotInterval ticks,the clients are staggered by phase.
+    auto tick = mTick++;
+    auto isDue = [tick](const ClientInfo& c) {return (tick + c.phase) % snapshotInterval == 0; };
+    std::set<uint8_t> due;
+    for (auto&& c : mClients)
+        if (isDue(c.second))
+            due.insert(c.second.group);
+    auto state = (tick / snapshotInterval) % 10 == 0;
+    //the simulation time in milliseconds,the clients interpolate with it.
+    auto time = static_cast<uint32_t>(static_cast<uint64_t>(tick) * 1000 / tickRate);
+
+    //record the world,every unit of every group is in it.
+    if (mReplay && tick % snapshotInterval == 0) {
+        Snapshot world;
+        for (auto&& g : mGroups)
+            for (auto&& u : g.second.units) {
+                auto&& x = u.second;
+                world.add(UnitSyncInfo{ u.first,x.getKind().getID(),x.getNode()->getTranslation(),
+                    x.getNode()->getRotation(),g.first,x.getAttackTarget(),x.getAttackPos(),
+                    x.getLoadSize(),x.getHP() });
+            }
+        for (auto&& b : mBullets)
+            world.add(BulletSyncInfo{ b.first,b.second.getKind(),b.second.getBound().center,
+                b.second.getNode()->getRotation() });
+        mReplay->write(time, std::move(world));
     }
+    mProfiler.lap(Phase::record);
 
     //choose a nearest object
-    for (auto&& x : update.units) {
-        auto old = x.second.getAttackTarget();
-        if (old && (!getUnitPos(old).isZero() || !x.second.getAttackPos().isZero()))continue;
-        auto p = x.second.getRoughPos();
-        float md = std::numeric_limits<float>::max();
-        uint32_t maxwell = 0;
-        if (x.second.getKind().getType() != "base") {
-            for (auto&& y : saw)
-                if (y.group != x.second.getGroup()) {
-                    auto dis = p.distanceSquared(y.pos);
-                    if (dis < md)
-                        md = dis, maxwell = y.id;
+    //the units are staggered by id,so each tick only a slice of them searches.
+    for (auto&& g : mGroups)
+        for (auto&& x : g.second.units) {
+            if ((x.first + tick) % retargetInterval || x.second.isDied())continue;
+            auto old = x.second.getAttackTarget();
+            if (old && (!getUnitPos(old).isZero() || !x.second.getAttackPos().isZero()))continue;
+            x.second.setAttackTarget(findTarget(x.second));
+        }
+
+    mProfiler.lap(Phase::target);
+
+    for (auto choose : due) {
+        GroupInfo& update = mGroups[choose];
+        auto seen = [&](Vector3 p) {return mVisibility.isVisible(choose, p); };
+
+        //update unit
+        std::vector<UnitSyncInfo> saw;
+        for (auto&& g : mGroups)
+            for (auto&& u : g.second.units) {
+                auto&& x = u.second;
+                auto p = x.getNode()->getTranslation();
+                if ((g.first == choose && !x.isDied()) || seen(p)) {
+                    saw.push_back({ u.first,x.getKind().getID(),p,x.getNode()->getRotation(),
+                        g.first,x.getAttackTarget(),x.getAttackPos(),
+                        g.first == choose ? x.getLoadSize() : 0
+                        ,x.getHP() });
                 }
-            if (maxwell != 0) {
-                for (auto&& y : bullets)
-                    if (mBullets[y.id].getGroup() != x.second.getGroup()) {
-                        auto dis = mBullets[y.id].getNode()->getTranslation().distanceSquared(p);
-                        if (dis < md)
-                            md = dis, maxwell = y.id + typeOffset;
-                    }
             }
+
+        //update bullet
+        std::vector<BulletSyncInfo> bullets;
+        for (auto&& b : mBullets) {
+            auto p = b.second.getBound().center;
+            if (b.second.getGroup() == choose || seen(p))
+                bullets.push_back({ b.first,b.second.getKind(),p,b.second.getNode()->getRotation() });
         }
-        x.second.setAttackTarget(maxwell);
-    }
 
-    //update state
-    if (mt() % 10 == 0) {
-        RakNet::BitStream data;
-        data.Write(ServerMessage::updateState);
-        for (auto&& x : update.weight)
-            data.Write(x);
-        float now = Game::getAbsoluteTime();
-        for (auto&& k : update.key) {
-            ProducingSyncInfo info{ k,mKey[k].id,std::max((mKey[k].time - now) / 1000.0f,0.0f) };
-            data.Write(info);
-        }
-        send(choose, data, PacketPriority::MEDIUM_PRIORITY);
+        //every client is encoded against its own acked baseline
+        {
+            Snapshot snapshot;
+            for (auto&& u : saw)
+                snapshot.add(u);
+            for (auto&& b : bullets)
+                snapshot.add(b);
+            for (auto&& c : mClients)
+                if (c.second.group == choose && isDue(c.second)) {
+                    RakNet::BitStream data;
+                    data.Write(ServerMessage::snapshot);
+                    data.Write(time);
+                    c.second.snapshot.write(data, Snapshot(snapshot));
+                    mPeer->Send(&data, PacketPriority::HIGH_PRIORITY,
+                        PacketReliability::UNRELIABLE_SEQUENCED, snapshotChannel, c.first, false);
+                    mProfiler.count(Counter::snapshotBytes, data.GetNumberOfBytesUsed());
+                }
+        }
+
+        //update state
+        if (state) {
+            RakNet::BitStream data;
+            data.Write(ServerMessage::updateState);
+            for (auto&& x : update.weight)
+                data.Write(x);
+            for (auto&& k : update.key) {
+                //the clients count down in real seconds.
+                auto left = static_cast<float>((mKey[k].time - mNow) / 1000.0 / mSpeed);
+                ProducingSyncInfo info{ k,mKey[k].id,std::max(left,0.0f) };
+                data.Write(info);
+            }
+            for (auto&& c : mClients)
+                if (c.second.group == choose && isDue(c.second)) {
+                    mPeer->Send(&data, PacketPriority::MEDIUM_PRIORITY,
+                        PacketReliability::RELIABLE_ORDERED, 0, c.first, false);
+                    mProfiler.count(Counter::stateBytes, data.GetNumberOfBytesUsed());
+                }
+        }
     }
+    mProfiler.lap(Phase::snapshot);
+    mProfiler.end();
 }
 
 void Server::stop() {
+    mRunning = false;
+    if (mThread.joinable())
+        mThread.join();
+    if (mState)
+        finish();
+}
+
+void Server::finish() {
+    mReplay.reset();
     mCheck.clear();
     mKey.clear();
+    mBullets.clear();
     mScene.reset();
     mGroups.clear();
     RakNet::BitStream data;
@@ -654,7 +853,7 @@ void Server::attack(uint32_t id, float harm) {
             auto i = units.find(id);
             if (i != units.end()) {
                 if (i->second.attacked(harm))
-                    mDeferred.push_back({ g.first,id,Game::getAbsoluteTime() });
+                    mDeferred.push_back({ g.first,id,mNow });
                 break;
             }
         }
@@ -672,6 +871,39 @@ void Server::newBullet(BulletInstance && bullet) {
     mScene->addNode(mBullets[id].getNode());
 }
 
+uint32_t Server::findTarget(const UnitInstance& unit) const {
+    if (unit.getKind().getUnitType() == UnitType::base)return 0;
+    auto group = unit.getGroup();
+    auto sight = mSight.find(group);
+    if (sight == mSight.cend())return 0;
+    auto p = unit.getRoughPos();
+    //every enemy the group sees is within reach.
+    auto reach = sight->second.reach(p);
+    float md = std::numeric_limits<float>::max();
+    uint32_t res = 0;
+    //the search starts at the range of the unit and grows until the nearest unit found is inside it,
+    //so nothing outside can be nearer.
+    for (auto r = std::min(std::max(unit.getRange(), Grid<UnitInstance*>::cellSize), reach); ;
+        r = std::min(r*2.0f, reach)) {
+        mUnitGrid.query(p, r, [&](uint32_t id, UnitInstance* u, const BoundingSphere& bs) {
+            if (u->getGroup() == group || u->isDied() || !mVisibility.isVisible(group, bs.center))return;
+            auto dis = p.distanceSquared(bs.center);
+            if (dis < md)
+                md = dis, res = id;
+        });
+        if ((res != 0 && md <= r*r) || r >= reach)break;
+    }
+    //a visible enemy bullet nearer than the target is shot down first.
+    if (res != 0)
+        mBulletGrid.query(p, std::sqrt(md), [&](uint32_t id, uint8_t g, const BoundingSphere& bs) {
+            if (g == group || !mVisibility.isVisible(group, bs.center))return;
+            auto dis = p.distanceSquared(bs.center);
+            if (dis < md)
+                md = dis, res = id + typeOffset;
+        });
+    return res;
+}
+
 Vector3 Server::getUnitPos(uint32_t id) const {
     if (id <= typeOffset) {
         for (auto&& g : mGroups) {
@@ -690,6 +922,10 @@ Vector3 Server::getUnitPos(uint32_t id) const {
 }
 
 void Server::changeSpeed(float speed) {
+    if (mRunning && std::this_thread::get_id() != mThread.get_id()) {
+        post([this, speed] {changeSpeed(speed); });
+        return;
+    }
     mSpeed = speed;
     RakNet::BitStream data;
     data.Write(ServerMessage::changeSpeed);
@@ -699,6 +935,30 @@ void Server::changeSpeed(float speed) {
             PacketReliability::RELIABLE_ORDERED, 0, c.first, false);
 }
 
+void Server::setSeed(uint64_t seed) {
+    mSeed = seed;
+    mDeterministic = true;
+}
+
+bool Server::logCommands(const std::string& path) {
+    mCommands.open(path, std::ios::binary);
+    if (!mCommands)return false;
+    uint32_t size = mMapName.size();
+    mCommands.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    mCommands.write(mMapName.data(), size);
+    mCommands.write(reinterpret_cast<const char*>(&mSeed), sizeof(mSeed));
+    mCommands.write(reinterpret_cast<const char*>(&mSpeed), sizeof(mSpeed));
+    return true;
+}
+
+void Server::record(const std::string& path) {
+    mReplay = std::make_unique<ReplayWriter>(path, mMapName);
+}
+
+bool Server::dumpProfile(const std::string& prefix) const {
+    return mProfiler.dumpCSV(prefix + ".csv") && mProfiler.dumpTrace(prefix + ".json");
+}
+
 void Server::releaseUnit(UnitInstance & instance) {
     std::uniform_real_distribution<float> URD(-1.0f, 1.0f);
     auto pos = instance.getRoughPos() + instance.getKind().getReleaseOffset();
@@ -718,7 +978,26 @@ void Server::releaseUnit(UnitInstance & instance) {
     }
 }
 
+bool Server::isRunning() const {
+    return mRunning;
+}
+
+Map& Server::getMap() {
+    return mMap;
+}
+
 GroupInfo::GroupInfo() :weight(globalUnits.size(), 1) {}
 
+void Server::SightInfo::merge(Vector3 p) {
+    min.x = std::min(min.x, p.x), min.y = std::min(min.y, p.z);
+    max.x = std::max(max.x, p.x), max.y = std::max(max.y, p.z);
+}
+
+float Server::SightInfo::reach(Vector3 p) const {
+    auto dx = std::max(std::abs(p.x - min.x), std::abs(p.x - max.x));
+    auto dz = std::max(std::abs(p.z - min.y), std::abs(p.z - max.y));
+    return std::sqrt(dx*dx + dz*dz);
+}
+
 KeyInfo::KeyInfo(Vector2 p) : owner(nil), id(none), pos(p) {}
 
@@ -1,12 +1,22 @@
 #pragma once
 #include "Map.h"
 #include "Unit.h"
+#include "Grid.h"
+#include "Visibility.h"
+#include "Replay.h"
+#include "Profiler.h"
+#include "Snapshot.h"
 #include <RakPeer.h>
 #include <string>
+#include <thread>
+#include <atomic>
+#include <functional>
 
 
 struct ClientInfo final {
     uint8_t group=1;
+    SnapshotEncoder snapshot;
+    uint8_t phase=0;
 };
 
 struct GroupInfo final {
@@ -18,6 +28,7 @@ struct GroupInfo final {
 
 struct KeyInfo final {
     const Vector2 pos;
+    static constexpr auto radius = 200.0f;
     static constexpr auto nil = std::numeric_limits<uint8_t>::max();
     uint8_t owner;
     static constexpr auto none = std::numeric_limits<uint16_t>::max();
@@ -44,6 +55,15 @@ private:
     };
     std::vector<DiedInfo> mDeferred;
 	float mSpeed;
+    uint32_t mTick;
+    //the simulation clock in milliseconds,it runs at the speed of the game.
+    double mNow;
+    uint64_t mSeed;
+    bool mDeterministic;
+    std::unique_ptr<ReplayWriter> mReplay;
+    //the commands of the clients with the ticks they are applied at.
+    std::ofstream mCommands;
+    Profiler mProfiler;
 
     struct CheckInfo {
         uint32_t id;
@@ -54,9 +74,48 @@ private:
         }
     };
     std::set<CheckInfo> mCheck;
+    Grid<UnitInstance*> mUnitGrid;
+    Grid<uint8_t> mBulletGrid;
+    //the hit bounds of the bullets,rebuilt in the bullet phase.
+    Grid<uint8_t> mHitGrid;
+    Visibility mVisibility;
+    //the rectangle around the living enemies each group sees,rebuilt after the visibility.
+    //a group missing from mSight sees no enemy.
+    struct SightInfo final {
+        Vector2 min, max;
+        void merge(Vector3 p);
+        //the distance from p to the farthest corner.
+        float reach(Vector3 p) const;
+    };
+    std::map<uint8_t, SightInfo> mSight;
+
+    //the simulation runs on its own thread with a fixed step.
+    static constexpr auto tickRate = 60;
+    static constexpr auto snapshotInterval = 3;
+    //an idle unit looks for a target once per retargetInterval ticks.
+    static constexpr auto retargetInterval = 6;
+    //the dead units are kept this long so that the clients can see them fall.
+    static constexpr auto corpseTime = 5000.0;
+    //a deterministic tick resolves the collisions in a fixed number of passes instead of a time budget.
+    static constexpr auto maxCollisionPass = 16;
+    std::thread mThread;
+    std::atomic_bool mRunning;
+
+    //commands posted by other threads,drained by the simulation thread before each tick.
+    struct Command final {
+        std::function<void()> func;
+        Command* next;
+    };
+    std::atomic<Command*> mInbox;
+    void post(std::function<void()> func);
+    void runCommands();
+    void loop();
 
     void send(uint8_t group,const RakNet::BitStream& data,PacketPriority priority);
+    void sendStats(const RakNet::SystemAddress& client);
     void chooseNew(KeyInfo& k);
+    uint32_t findTarget(const UnitInstance& unit) const;
+    void finish();
 public:
     Server(const std::string& path);
     ~Server();
@@ -71,7 +130,19 @@ public:
     void newBullet(BulletInstance&& bullet);
     Vector3 getUnitPos(uint32_t id) const;
 	void changeSpeed(float speed);
+    //a seeded match is deterministic:the same commands at the same ticks play the same game.
+    //the clients still get snapshots,logCommands keeps the commands that reproduce the match.
+    void setSeed(uint64_t seed);
+    //writes the map,the seed and the speed,then tick,group,size and bytes of every command of the clients.
+    //call it after changeSpeed and setSeed.
+    bool logCommands(const std::string& path);
+    //writes the whole world to path every snapshotInterval ticks.
+    void record(const std::string& path);
+    //writes the latest ticks to prefix.csv and prefix.json,call it when the match is over.
+    bool dumpProfile(const std::string& prefix) const;
     void releaseUnit(UnitInstance& instance);
+    bool isRunning() const;
+    Map& getMap();
 };
 
 extern std::unique_ptr<Server> localServer;
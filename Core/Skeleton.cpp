@@ -0,0 +1,136 @@
+#include "Skeleton.h"
+#include <cstring>
+
+namespace {
+    //reads the nodes of a gpb bundle and skips everything else.
+    class GPBReader final {
+    private:
+        uniqueRAII<Stream> mStream;
+        std::map<uint32_t, std::string> mID;
+        std::map<std::string, uint32_t> mNode;
+
+        template<typename T>
+        T read() {
+            T res{};
+            mStream->read(&res, sizeof(T), 1);
+            return res;
+        }
+
+        std::string readString() {
+            auto size = read<uint32_t>();
+            std::string res(size, '\0');
+            if (size)mStream->read(&res[0], 1, size);
+            return res;
+        }
+
+        void skip(size_t size) {
+            mStream->seek(size, SEEK_CUR);
+        }
+
+        Node* readNode() {
+            auto id = mID.find(static_cast<uint32_t>(mStream->position()));
+            auto node = Node::create(id == mID.cend() ? nullptr : id->second.c_str());
+            read<uint32_t>();
+            float transform[16];
+            mStream->read(transform, sizeof(float), 16);
+            Vector3 scale, translation;
+            Quaternion rotation;
+            Matrix(transform).decompose(&scale, &rotation, &translation);
+            node->setScale(scale);
+            node->setRotation(rotation);
+            node->setTranslation(translation);
+            readString();
+
+            auto children = read<uint32_t>();
+            for (uint32_t i = 0; i < children; ++i) {
+                uniqueRAII<Node> child = readNode();
+                node->addChild(child.get());
+            }
+
+            auto camera = read<uint8_t>();
+            if (camera)skip(sizeof(float)*(camera == Camera::PERSPECTIVE ? 4 : 5));
+            auto light = read<uint8_t>();
+            if (light)skip(sizeof(float)*(light == Light::DIRECTIONAL ? 3 : (light == Light::POINT ? 4 : 6)));
+
+            auto mesh = readString();
+            if (mesh.size() > 1 && mesh[0] == '#') {
+                if (read<uint8_t>()) {
+                    skip(sizeof(float) * 16);
+                    auto joints = read<uint32_t>();
+                    for (uint32_t i = 0; i < joints; ++i)
+                        readString();
+                    skip(sizeof(float)*read<uint32_t>());
+                }
+                auto materials = read<uint32_t>();
+                for (uint32_t i = 0; i < materials; ++i)
+                    readString();
+            }
+            return node;
+        }
+    public:
+        GPBReader(const std::string& path) :mStream(FileSystem::open(path.c_str())) {
+            char sig[9];
+            if (!mStream || mStream->read(sig, 1, 9) != 9 || std::memcmp(sig, "\xABGPB\xBB\r\n\x1A\n", 9) != 0)
+                GP_ERROR("Failed to open the bundle %s.", path.c_str());
+            skip(2);
+            auto refs = read<uint32_t>();
+            for (uint32_t i = 0; i < refs; ++i) {
+                auto id = readString();
+                auto type = read<uint32_t>();
+                auto offset = read<uint32_t>();
+                mID[offset] = id;
+                //BUNDLE_TYPE_NODE
+                if (type == 2)mNode[id] = offset;
+            }
+        }
+
+        Node* loadNode(const std::string& id) {
+            auto iter = mNode.find(id);
+            if (iter == mNode.cend()) {
+                INFO("No node named ", id);
+                return nullptr;
+            }
+            mStream->seek(iter->second, SEEK_SET);
+            return readNode();
+        }
+    };
+
+    Node* loadNode(Properties* info) {
+        Node* node = nullptr;
+        std::string url = info->getString("url", "");
+        if (url.size()) {
+            auto pos = url.find('#');
+            node = GPBReader(url.substr(0, pos)).loadNode(pos == std::string::npos ? "" : url.substr(pos + 1));
+            if (!node)return nullptr;
+            node->setId(info->getId());
+        }
+        else node = Node::create(info->getId());
+
+        Vector3 v;
+        Quaternion r;
+        if (info->getVector3("translate", &v))node->translate(v);
+        if (info->exists("rotate") && Properties::parseAxisAngle(info->getString("rotate"), &r))node->rotate(r);
+        if (info->getVector3("scale", &v))node->scale(v);
+
+        for (auto child = info->getNextNamespace(); child; child = info->getNextNamespace())
+            if (std::strcmp(child->getNamespace(), "node") == 0) {
+                uniqueRAII<Node> c = loadNode(child);
+                if (c)node->addChild(c.get());
+            }
+        return node;
+    }
+}
+
+Scene* loadSkeleton(const std::string& path) {
+    uniqueRAII<Properties> info = Properties::create(path.c_str());
+    if (!info)return nullptr;
+    auto scene = std::strlen(info->getNamespace()) ? info.get() : info->getNextNamespace();
+    if (!scene)return nullptr;
+    auto res = Scene::create(scene->getId());
+    for (auto ns = scene->getNextNamespace(); ns; ns = scene->getNextNamespace())
+        if (std::strcmp(ns->getNamespace(), "node") == 0) {
+            uniqueRAII<Node> node = loadNode(ns);
+            if (node)res->addNode(node.get());
+        }
+    return res;
+}
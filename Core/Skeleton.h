@@ -0,0 +1,6 @@
+#pragma once
+#include "common.h"
+
+//loads the node hierarchy of a model scene without meshes,materials or particles.
+//the dedicated server has no renderer but the controllers still need the transforms.
+Scene* loadSkeleton(const std::string& path);
@@ -0,0 +1,329 @@
+#include "Snapshot.h"
+#include <algorithm>
+
+namespace {
+    constexpr auto minY = -1024.0f, maxY = 3072.0f;
+    constexpr auto HPScale = 16.0f;
+
+    uint16_t quantize(float x, float min, float max) {
+        auto t = std::min(std::max((x - min) / (max - min), 0.0f), 1.0f);
+        return static_cast<uint16_t>(std::lround(t*65535.0f));
+    }
+
+    float dequantize(uint16_t x, float min, float max) {
+        return min + x / 65535.0f*(max - min);
+    }
+
+    void quantize(Vector3 p, uint16_t* res) {
+        res[0] = quantize(p.x, -mapSizeHF, mapSizeHF);
+        res[1] = quantize(p.y, minY, maxY);
+        res[2] = quantize(p.z, -mapSizeHF, mapSizeHF);
+    }
+
+    Vector3 dequantize(const uint16_t* p) {
+        return { dequantize(p[0], -mapSizeHF, mapSizeHF),dequantize(p[1], minY, maxY),
+            dequantize(p[2], -mapSizeHF, mapSizeHF) };
+    }
+
+    //smallest three:the index of the largest component and the other three in 10 bits each.
+    uint32_t packRotation(Quaternion q) {
+        q.normalize();
+        float c[4] = { q.x,q.y,q.z,q.w };
+        uint32_t big = 0;
+        for (uint32_t i = 1; i < 4; ++i)
+            if (std::fabs(c[i]) > std::fabs(c[big]))
+                big = i;
+        auto sign = c[big] < 0.0f ? -1.0f : 1.0f;
+        auto res = big;
+        for (uint32_t i = 0; i < 4; ++i)
+            if (i != big) {
+                auto t = std::min(std::max((c[i] * sign*std::sqrt(2.0f) + 1.0f)*0.5f, 0.0f), 1.0f);
+                res = res << 10 | static_cast<uint32_t>(std::lround(t*1023.0f));
+            }
+        return res;
+    }
+
+    Quaternion unpackRotation(uint32_t x) {
+        auto big = x >> 30;
+        float c[4];
+        auto sum = 0.0f;
+        for (auto i = 3; i >= 0; --i)
+            if (i != static_cast<int>(big)) {
+                c[i] = ((x & 1023) / 1023.0f*2.0f - 1.0f) / std::sqrt(2.0f);
+                sum += c[i] * c[i];
+                x >>= 10;
+            }
+        c[big] = std::sqrt(std::max(1.0f - sum, 0.0f));
+        return { c[0],c[1],c[2],c[3] };
+    }
+
+    void writePos(RakNet::BitStream& data, const uint16_t* p) {
+        for (auto i = 0; i < 3; ++i)
+            data.Write(p[i]);
+    }
+
+    bool readPos(RakNet::BitStream& data, uint16_t* p) {
+        return data.Read(p[0]) && data.Read(p[1]) && data.Read(p[2]);
+    }
+
+    enum class TargetType : uint8_t {
+        none, unit, bullet, point
+    };
+
+    void writeTarget(RakNet::BitStream& data, uint32_t at, const uint16_t* atp) {
+        auto type = at == 0 ? TargetType::none : (at == pointID ? TargetType::point :
+            (at > typeOffset ? TargetType::bullet : TargetType::unit));
+        data.WriteBitsFromIntegerRange<uint8_t>(static_cast<uint8_t>(type), 0, 3, 2);
+        if (type == TargetType::unit)data.WriteCompressed(at);
+        else if (type == TargetType::bullet)data.WriteCompressed(at - typeOffset);
+        else if (type == TargetType::point)data.Write(atp[0]), data.Write(atp[1]);
+    }
+
+    bool readTarget(RakNet::BitStream& data, uint32_t& at, uint16_t* atp) {
+        uint8_t type;
+        if (!data.ReadBitsFromIntegerRange<uint8_t>(type, 0, 3, 2))return false;
+        atp[0] = atp[1] = 0;
+        switch (static_cast<TargetType>(type)) {
+        case TargetType::none:at = 0;
+            return true;
+        case TargetType::unit:return data.ReadCompressed(at);
+        case TargetType::bullet:
+            if (!data.ReadCompressed(at))return false;
+            at += typeOffset;
+            return true;
+        default:at = pointID;
+            return data.Read(atp[0]) && data.Read(atp[1]);
+        }
+    }
+
+    bool same(const UnitState& lhs, const UnitState& rhs) {
+        return std::equal(lhs.pos, lhs.pos + 3, rhs.pos) && lhs.rotation == rhs.rotation &&
+            lhs.at == rhs.at && std::equal(lhs.atp, lhs.atp + 2, rhs.atp) && lhs.size == rhs.size &&
+            lhs.HP == rhs.HP && lhs.kind == rhs.kind && lhs.group == rhs.group;
+    }
+
+    bool same(const BulletState& lhs, const BulletState& rhs) {
+        return std::equal(lhs.pos, lhs.pos + 3, rhs.pos) && lhs.rotation == rhs.rotation &&
+            lhs.kind == rhs.kind;
+    }
+
+    //a full state carries every field,otherwise a bit tells whether each field follows.
+    void writeState(RakNet::BitStream& data, const UnitState* base, const UnitState& now) {
+        auto full = base == nullptr || base->kind != now.kind || base->group != now.group;
+        data.Write(full);
+        auto changed = [&](bool diff) {
+            if (full)return true;
+            data.Write(diff);
+            return diff;
+        };
+        if (full) {
+            data.Write(now.kind);
+            data.WriteBitsFromIntegerRange<uint8_t>(now.group, 0, 7, 3);
+        }
+        if (changed(full || !std::equal(now.pos, now.pos + 3, base->pos)))
+            writePos(data, now.pos);
+        if (changed(full || now.rotation != base->rotation))
+            data.Write(now.rotation);
+        if (changed(full || now.at != base->at || !std::equal(now.atp, now.atp + 2, base->atp)))
+            writeTarget(data, now.at, now.atp);
+        if (changed(full || now.size != base->size))
+            data.WriteCompressed(now.size);
+        if (changed(full || now.HP != base->HP))
+            data.Write(now.HP);
+    }
+
+    bool readState(RakNet::BitStream& data, const UnitState* base, UnitState& res) {
+        bool full;
+        if (!data.Read(full))return false;
+        if (!full) {
+            if (!base)return false;
+            res = *base;
+        }
+        auto changed = [&] {
+            auto diff = true;
+            return full || (data.Read(diff) && diff);
+        };
+        if (full && !(data.Read(res.kind) && data.ReadBitsFromIntegerRange<uint8_t>(res.group, 0, 7, 3)))
+            return false;
+        if (changed() && !readPos(data, res.pos))return false;
+        if (changed() && !data.Read(res.rotation))return false;
+        if (changed() && !readTarget(data, res.at, res.atp))return false;
+        if (changed() && !data.ReadCompressed(res.size))return false;
+        if (changed() && !data.Read(res.HP))return false;
+        return true;
+    }
+
+    void writeState(RakNet::BitStream& data, const BulletState* base, const BulletState& now) {
+        auto full = base == nullptr || base->kind != now.kind;
+        data.Write(full);
+        auto changed = [&](bool diff) {
+            if (full)return true;
+            data.Write(diff);
+            return diff;
+        };
+        if (full)data.Write(now.kind);
+        if (changed(full || !std::equal(now.pos, now.pos + 3, base->pos)))
+            writePos(data, now.pos);
+        if (changed(full || now.rotation != base->rotation))
+            data.Write(now.rotation);
+    }
+
+    bool readState(RakNet::BitStream& data, const BulletState* base, BulletState& res) {
+        bool full;
+        if (!data.Read(full))return false;
+        if (!full) {
+            if (!base)return false;
+            res = *base;
+        }
+        auto changed = [&] {
+            auto diff = true;
+            return full || (data.Read(diff) && diff);
+        };
+        if (full && !data.Read(res.kind))return false;
+        if (changed() && !readPos(data, res.pos))return false;
+        if (changed() && !data.Read(res.rotation))return false;
+        return true;
+    }
+
+    //ids are sent in ascending order as differences,removed objects carry no state.
+    template<typename State>
+    void writeDelta(RakNet::BitStream& data, const std::map<uint32_t, State>& base,
+        const std::map<uint32_t, State>& now) {
+        std::vector<std::pair<uint32_t, const State*>> changes;
+        auto b = base.cbegin();
+        for (auto&& x : now) {
+            for (; b != base.cend() && b->first < x.first; ++b)
+                changes.emplace_back(b->first, nullptr);
+            if (b != base.cend() && b->first == x.first) {
+                if (!same(b->second, x.second))
+                    changes.emplace_back(x.first, &x.second);
+                ++b;
+            }
+            else changes.emplace_back(x.first, &x.second);
+        }
+        for (; b != base.cend(); ++b)
+            changes.emplace_back(b->first, nullptr);
+
+        data.WriteCompressed(static_cast<uint32_t>(changes.size()));
+        uint32_t last = 0;
+        for (auto&& c : changes) {
+            data.WriteCompressed(c.first - last);
+            last = c.first;
+            data.Write(c.second != nullptr);
+            if (c.second) {
+                auto old = base.find(c.first);
+                writeState(data, old == base.cend() ? nullptr : &old->second, *c.second);
+            }
+        }
+    }
+
+    template<typename State>
+    bool readDelta(RakNet::BitStream& data, std::map<uint32_t, State>& res) {
+        uint32_t size;
+        if (!data.ReadCompressed(size))return false;
+        uint32_t id = 0;
+        for (uint32_t i = 0; i < size; ++i) {
+            uint32_t delta;
+            bool alive;
+            if (!data.ReadCompressed(delta) || !data.Read(alive))return false;
+            id += delta;
+            if (!alive) {
+                res.erase(id);
+                continue;
+            }
+            auto old = res.find(id);
+            State state;
+            if (!readState(data, old == res.cend() ? nullptr : &old->second, state))return false;
+            res[id] = state;
+        }
+        return true;
+    }
+}
+
+void Snapshot::add(const UnitSyncInfo& info) {
+    UnitState state;
+    state.kind = info.kind;
+    state.group = info.group;
+    quantize(info.pos, state.pos);
+    state.rotation = packRotation(info.rotation);
+    state.at = info.at;
+    state.atp[0] = state.atp[1] = 0;
+    if (info.at == pointID) {
+        state.atp[0] = quantize(info.atp.x, -mapSizeHF, mapSizeHF);
+        state.atp[1] = quantize(info.atp.y, -mapSizeHF, mapSizeHF);
+    }
+    state.size = info.size;
+    state.HP = info.HP <= 0.0f ? 0 :
+        static_cast<uint16_t>(std::min(std::max(std::ceil(info.HP*HPScale), 1.0f), 65535.0f));
+    units[info.id] = state;
+}
+
+void Snapshot::add(const BulletSyncInfo& info) {
+    BulletState state;
+    state.kind = info.kind;
+    quantize(info.pos, state.pos);
+    state.rotation = packRotation(info.rotation);
+    bullets[info.id] = state;
+}
+
+std::vector<UnitSyncInfo> Snapshot::getUnits() const {
+    std::vector<UnitSyncInfo> res;
+    res.reserve(units.size());
+    for (auto&& x : units) {
+        auto&& s = x.second;
+        res.push_back({ x.first,s.kind,dequantize(s.pos),unpackRotation(s.rotation),s.group,s.at,
+            { dequantize(s.atp[0], -mapSizeHF, mapSizeHF),dequantize(s.atp[1], -mapSizeHF, mapSizeHF) },
+            s.size,s.HP / HPScale });
+    }
+    return res;
+}
+
+std::vector<BulletSyncInfo> Snapshot::getBullets() const {
+    std::vector<BulletSyncInfo> res;
+    res.reserve(bullets.size());
+    for (auto&& x : bullets)
+        res.push_back({ x.first,x.second.kind,dequantize(x.second.pos),unpackRotation(x.second.rotation) });
+    return res;
+}
+
+SnapshotEncoder::SnapshotEncoder() :mSeq(0), mAck(0) {}
+
+void SnapshotEncoder::write(RakNet::BitStream& data, Snapshot&& snapshot) {
+    static const Snapshot empty;
+    auto base = std::find_if(mSent.cbegin(), mSent.cend(), [this](auto&& x) {return x.first == mAck; });
+    auto&& old = base == mSent.cend() ? empty : base->second;
+    data.Write(++mSeq);
+    data.Write(base == mSent.cend() ? 0U : mAck);
+    writeDelta(data, old.units, snapshot.units);
+    writeDelta(data, old.bullets, snapshot.bullets);
+    mSent.emplace_back(mSeq, std::move(snapshot));
+    while (mSent.size() > snapshotWindow)
+        mSent.pop_front();
+}
+
+void SnapshotEncoder::ack(uint32_t seq) {
+    if (seq > mAck && seq <= mSeq)
+        mAck = seq;
+}
+
+bool SnapshotDecoder::readMessage(RakNet::BitStream& data, uint32_t& time, uint32_t& seq,
+    const Snapshot*& snapshot) {
+    return data.Read(time) && read(data, seq, snapshot);
+}
+
+bool SnapshotDecoder::read(RakNet::BitStream& data, uint32_t& seq, const Snapshot*& snapshot) {
+    uint32_t base;
+    if (!data.Read(seq) || !data.Read(base))return false;
+    Snapshot res;
+    if (base) {
+        auto iter = std::find_if(mReceived.cbegin(), mReceived.cend(), [base](auto&& x) {return x.first == base; });
+        if (iter == mReceived.cend())return false;
+        res = iter->second;
+    }
+    if (!readDelta(data, res.units) || !readDelta(data, res.bullets))return false;
+    mReceived.emplace_back(seq, std::move(res));
+    while (mReceived.size() > snapshotWindow)
+        mReceived.pop_front();
+    snapshot = &mReceived.back().second;
+    return true;
+}
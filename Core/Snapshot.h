@@ -0,0 +1,60 @@
+#pragma once
+#include "common.h"
+#include "Message.h"
+#include <BitStream.h>
+#include <map>
+#include <deque>
+
+//quantized states,a field is sent only when it differs from the baseline.
+struct UnitState final {
+    uint16_t kind;
+    uint8_t group;
+    uint16_t pos[3];
+    uint32_t rotation;
+    uint32_t at;
+    uint16_t atp[2];
+    uint32_t size;
+    uint16_t HP;
+};
+
+struct BulletState final {
+    uint16_t kind;
+    uint16_t pos[3];
+    uint32_t rotation;
+};
+
+struct Snapshot final {
+    std::map<uint32_t, UnitState> units;
+    std::map<uint32_t, BulletState> bullets;
+    void add(const UnitSyncInfo& info);
+    void add(const BulletSyncInfo& info);
+    std::vector<UnitSyncInfo> getUnits() const;
+    std::vector<BulletSyncInfo> getBullets() const;
+};
+
+//snapshots are sent UNRELIABLE_SEQUENCED on their own ordering channel.
+constexpr char snapshotChannel = 1;
+
+//both sides keep this many snapshots,older baselines are replaced by a full snapshot.
+constexpr auto snapshotWindow = 32U;
+
+//one per client on the server,encodes each snapshot against the latest one acked by the client.
+class SnapshotEncoder final {
+private:
+    uint32_t mSeq, mAck;
+    std::deque<std::pair<uint32_t, Snapshot>> mSent;
+public:
+    SnapshotEncoder();
+    void write(RakNet::BitStream& data, Snapshot&& snapshot);
+    void ack(uint32_t seq);
+};
+
+class SnapshotDecoder final {
+private:
+    std::deque<std::pair<uint32_t, Snapshot>> mReceived;
+public:
+    //returns false when the baseline of the snapshot is no longer known.
+    bool read(RakNet::BitStream& data, uint32_t& seq, const Snapshot*& snapshot);
+    //a ServerMessage::snapshot after its id:the server time,then the snapshot.
+    bool readMessage(RakNet::BitStream& data, uint32_t& time, uint32_t& seq, const Snapshot*& snapshot);
+};
@@ -2,6 +2,8 @@
 #include "UI.h"
 #include "Server.h"
 #include "Client.h"
+#include "Pak.h"
+#include "Loader.h"
 #include <ctime>
 #include <fstream>
 
@@ -63,7 +65,8 @@ void show(float x) {
     Platform::swapBuffers();
 }
 
-void unpackPack(Stream* pak, uint64_t& p, uint64_t all) {
+//only writes the files that are not on disk as the manifest says.
+void unpackPack(Stream* pak, uint64_t& p, uint64_t all, const PakManifest& old, PakManifest& now) {
     struct Path final {
         char name[60] = {};
         uint32_t size = 0;
@@ -72,114 +75,101 @@ void unpackPack(Stream* pak, uint64_t& p, uint64_t all) {
     std::string path = FileSystem::getResourcePath();
 
     while (pak->read(&tmp, sizeof(tmp), 1)) {
+        std::vector<char> data(tmp.size);
+        pak->read(data.data(), tmp.size, 1);
+        p += tmp.size + sizeof(tmp);
+        auto hash = hashData(data.data(), data.size());
+        //a file another pak has written in this run must be overwritten.
+        auto fresh = now.files.find(tmp.name) == now.files.cend();
+        now.files[tmp.name] = { hash,true };
+        auto it = old.files.find(tmp.name);
+        if (fresh && it != old.files.cend() && it->second.unpacked && it->second.hash == hash
+            && FileSystem::fileExists(tmp.name))
+            continue;
         INFO("Unpacking File ", tmp.name);
         buildDir(tmp.name);
         auto file = fopen((path + tmp.name).c_str(), "wb");
-        std::vector<char> data(tmp.size);
-        pak->read(data.data(), tmp.size, 1);
         if (!file)INFO("No");
         fwrite(data.data(), tmp.size, 1, file);
         fclose(file);
-        p += tmp.size + sizeof(tmp);
         show(static_cast<float>(p) / all);
     }
 }
 
-void unpackAllPacks() {
+//the indexed paks are mounted in place,only the old ones are still unpacked to res.
+void loadAllPacks() {
     INFO("Checking key");
-    std::vector<std::string> paks;
-    FileSystem::listFiles("paks", paks);
-    paks.erase(std::remove_if(paks.begin(), paks.end(),
-        [](const std::string& name) {return !(name.size() > 4
-            && name.substr(name.size() - 4, 4) == ".pak"); }),paks.end());
-
-    uint64_t key = 0;
-    struct PackInfo final {
-        uniqueRAII<Stream> data;
-        uint8_t height;
-        std::string name;
-        uint8_t id;
-    };
-    std::vector<PackInfo> pakData;
-    uint8_t cnt = 0;
-    uint64_t size = 0;
+    FileSystem::setProvider(nullptr);
+    resourceLoader.setNext(nullptr);
+    pakFileSystem.clear();
+    auto paks = listPaks();
+
+    uint64_t key = 0, size = 0;
     pakKey = 0;
     for (auto&& p : paks) {
-        uniqueRAII<Stream> data = FileSystem::open(("paks/" + p).c_str());
-        bool local;
-        data->read(&local, sizeof(local), 1);
-        uint64_t k;
-        data->read(&k, sizeof(k), 1);
-        if (!local)pakKey ^= k;
-        key ^= k;
-        size += data->length();
-        pakData.push_back({ std::move(data), 0,p,cnt });
-        ++cnt;
-    }
-
-    bool reload = false;
-    {
-        uniqueRAII<Stream> keyCache = FileSystem::open("key");
-        uint64_t oldKey;
-        if (!keyCache || keyCache->read(&oldKey, sizeof(oldKey), 1) == 0 || oldKey != key)
-            reload = true;
-    }
-
-    if (!reload)return;
-
-    removeAll("res");
-
-    std::map<std::string, std::vector<uint8_t>> parents;
-    std::set<uint8_t> out;
-    for (auto&& p : pakData) {
-        uint8_t num;
-        p.data->read(&num, sizeof(num), 1);
-        char str[32];
-        for (uint8_t i = 0; i < num; ++i) {
-            p.data->read(str, 32, 1);
-            auto it = std::find_if(pakData.cbegin(), pakData.cend(), [&](auto&& x) {return x.name == str; });
-            if (it != pakData.cend())
-                parents[p.name].emplace_back(it->id);
-            else {
-                INFO("The pak ", p.name, "is base of a pak named ", str);
-                throw;
-            }
-            out.insert(p.id);
+        if (!p.local)pakKey ^= p.key;
+        if (!p.indexed) {
+            key ^= p.key;
+            size += p.size;
         }
     }
 
-    uint64_t pos = 0;
-    for (auto&& p : pakData)
-        pos += p.data->position();
+    PakManifest old, now;
+    auto first = !old.read("manifest");
+    now.key = key;
+    auto reload = first || old.key != key;
 
-    if (out.size() == pakData.size())
-        GP_ERROR("Circular reference.");
-
-    std::set<uint8_t> unpacked;
+    uint64_t pos = 0;
+    if (reload) {
+        //without a manifest nobody knows what is in res.
+        if (first)
+            removeAll("res");
+        glEnable(GL_SCISSOR_TEST);
+        show(0.0f);
+    }
+    else {
+        for (auto&& f : old.files)
+            if (f.second.unpacked)
+                now.files.emplace(f);
+    }
 
-    std::function<void(uint8_t)> visit = [&](uint8_t id) {
-        for (auto&& c : parents[pakData[id].name])
-            visit(c);
-        if (unpacked.find(id) == unpacked.cend()) {
-            INFO("Unpacking ", pakData[id].name);
-            unpackPack(pakData[id].data.get(), pos, size);
-            unpacked.insert(id);
+    //the bases come first,so the files of a pak override the ones of its bases.
+    for (auto&& p : paks) {
+        if (p.indexed)
+            pakFileSystem.mount("paks/" + p.name);
+        else if (reload) {
+            INFO("Unpacking ", p.name);
+            uniqueRAII<Stream> data = FileSystem::open(("paks/" + p.name).c_str());
+            data->seek(p.headerSize, SEEK_SET);
+            pos += p.headerSize;
+            unpackPack(data.get(), pos, size, old, now);
         }
-    };
-
-    glEnable(GL_SCISSOR_TEST);
-    show(static_cast<float>(pos) / size);
-
-    for (auto&& x : out)
-        visit(x);
-
-    for (auto&& x : pakData)
-        visit(x.id);
+    }
 
-    glDisable(GL_SCISSOR_TEST);
+    if (reload) {
+        for (auto&& f : old.files)
+            if (f.second.unpacked && now.files.find(f.first) == now.files.cend()) {
+                INFO("Removing File ", f.first);
+                remove((FileSystem::getResourcePath() + f.first).c_str());
+            }
+        glDisable(GL_SCISSOR_TEST);
+    }
 
-    uniqueRAII<Stream> keyCache = FileSystem::open("key", FileSystem::WRITE);
-    keyCache->write(&key, sizeof(key), 1);
+    pakFileSystem.collect(now);
+    size_t changed = 0;
+    for (auto&& f : now.files) {
+        auto it = old.files.find(f.first);
+        if (it == old.files.cend() || it->second.hash != f.second.hash)
+            ++changed;
+    }
+    for (auto&& f : old.files)
+        if (now.files.find(f.first) == now.files.cend())
+            ++changed;
+    INFO(changed, " of ", now.files.size(), " files changed since the last run.");
+
+    resourceLoader.setNext(&pakFileSystem);
+    FileSystem::setProvider(&resourceLoader);
+    now.write("manifest");
 }
 
 void readSettings() {
@@ -194,6 +184,8 @@ void readSettings() {
         reflection = info->getFloat("reflection");
         audioLevel = info->getInt("audioLevel");
         gain = info->getFloat("gain");
+        if (info->exists("interpolationDelay"))
+            interpolationDelay = info->getFloat("interpolationDelay");
     }
 }
 
@@ -224,7 +216,7 @@ private:
         }
 #endif // ANDROID
 
-        unpackAllPacks();
+        loadAllPacks();
 
         INFO("Done.");
     }
@@ -384,6 +376,7 @@ public:
             {
                 switch (key) {
                 case Keyboard::KEY_F: localClient->follow(); break;
+                case Keyboard::KEY_P: localClient->askStats(); break;
                 case Keyboard::KEY_W:mIsPressed[0] = 1; break;
                 case Keyboard::KEY_S:mIsPressed[1] = 1; break;
                 case Keyboard::KEY_A:mIsPressed[2] = 1; break;
@@ -0,0 +1,84 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+
+void ThreadPool::work() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mNotify.wait(lock, [this] {return mStop || mTasks.size(); });
+            if (mTasks.empty())return;
+            task = std::move(mTasks.front());
+            mTasks.pop_front();
+        }
+        task();
+    }
+}
+
+void ThreadPool::push(std::function<void()>&& task) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mTasks.emplace_back(std::move(task));
+    }
+    mNotify.notify_one();
+}
+
+ThreadPool::ThreadPool(size_t num) :mStop(false) {
+    if (num == 0) {
+        auto cores = std::thread::hardware_concurrency();
+        num = cores > 1 ? cores - 1 : 1;
+    }
+    for (size_t i = 0; i < num; ++i)
+        mWorkers.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mNotify.notify_all();
+    for (auto&& w : mWorkers)
+        w.join();
+}
+
+size_t ThreadPool::size() const {
+    return mWorkers.size();
+}
+
+void ThreadPool::parallelFor(size_t num, const std::function<void(size_t)>& func) {
+    if (num == 0)return;
+    struct State final {
+        std::atomic<size_t> next, done;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    //the helpers may start after the caller has returned,so they share the state.
+    auto state = std::make_shared<State>();
+    state->next = 0;
+    state->done = 0;
+    auto run = [state, num, &func] {
+        size_t i, count = 0;
+        while ((i = state->next++) < num) {
+            func(i);
+            ++count;
+        }
+        if (count && (state->done += count) == num) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->finished.notify_all();
+        }
+    };
+    //a helper that starts late finds no work and never touches func.
+    auto helpers = std::min(num - 1, mWorkers.size());
+    for (size_t i = 0; i < helpers; ++i)
+        push(run);
+    run();
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&] {return state->done == num; });
+}
+
+ThreadPool& getThreadPool() {
+    static ThreadPool pool;
+    return pool;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool final {
+private:
+    std::vector<std::thread> mWorkers;
+    std::deque<std::function<void()>> mTasks;
+    std::mutex mMutex;
+    std::condition_variable mNotify;
+    bool mStop;
+    void work();
+    void push(std::function<void()>&& task);
+public:
+    //at least one worker,by default one less than the cores so the main thread keeps its own.
+    explicit ThreadPool(size_t num = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    size_t size() const;
+
+    template<typename Func>
+    auto submit(Func&& func) {
+        using Result = decltype(func());
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Func>(func));
+        auto res = task->get_future();
+        push([task] {(*task)(); });
+        return res;
+    }
+
+    //calls func(0..num-1) on the workers and the calling thread,returns when all of them are done.
+    //it is safe to call from a worker,the caller takes the work nobody has picked up.
+    void parallelFor(size_t num, const std::function<void(size_t)>& func);
+};
+
+//shared by the pak loader and the resource loading.
+ThreadPool& getThreadPool();
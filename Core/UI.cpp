@@ -219,7 +219,7 @@ PlayMenu:: ~PlayMenu() {
 
 SettingsMenu::SettingsMenu() :UI("Settings") { read(); }
 
-extern void unpackAllPacks();
+extern void loadAllPacks();
 
 void SettingsMenu::event(Control * control, Event evt) {
     CHECKRET();
@@ -228,7 +228,7 @@ void SettingsMenu::event(Control * control, Event evt) {
         get<Slider>("height")->setValue(Game::getInstance()->getHeight());
     }
     if (evt == Event::PRESS && CMPID("reload")) {
-        unpackAllPacks();
+        loadAllPacks();
         globalUnits.clear();
         loadAllUnits();
         globalBullets.clear();
@@ -245,7 +245,8 @@ void writeSettings() {
         << "waterAlpha=" << waterAlpha << std::endl
         << "reflection=" << reflection << std::endl
         << "audioLevel=" << audioLevel << std::endl
-        << "gain=" << gain << std::endl;
+        << "gain=" << gain << std::endl
+        << "interpolationDelay=" << interpolationDelay << std::endl;
 
     auto str = ss.str();
     uniqueRAII<Stream> file = FileSystem::open("game.settings", FileSystem::WRITE);
@@ -265,6 +266,7 @@ void SettingsMenu::read() {
     get<Slider>("waterRef")->setValue(reflection);
     get<Slider>("audioLevel")->setValue(audioLevel);
     get<Slider>("gain")->setValue(gain);
+    get<Slider>("delay")->setValue(interpolationDelay);
 }
 
 SettingsMenu::~SettingsMenu() {
@@ -304,6 +306,7 @@ window
     reflection = get <Slider>("waterRef")->getValue();
     gain = get<Slider>("gain")->getValue();
     audioLevel = get <Slider>("audioLevel")->getValue();
+    interpolationDelay = get<Slider>("delay")->getValue();
     writeSettings();
 }
 
@@ -423,7 +426,6 @@ void GameMain::event(Control * control, Event evt) {
 void GameMain::update(float delta) {
     get<Label>("state")->setText(("FPS :" + to_string(Game::getInstance()->getFrameRate()) +
         " Unit:" + to_string(localClient->getUnitNum())).c_str());
-    if (localServer)localServer->update(delta);
     localClient->setViewport(mForm->getWidth());
     if (localClient->update(delta))
         get<Slider>("weight")->setValue(localClient->getWeight(mCurrent));
@@ -1,10 +1,16 @@
 #include "Server.h"
-#include "Client.h"
+#include "Message.h"
 #include "Unit.h"
+#include "Loader.h"
+#include "Skeleton.h"
+#ifndef TFL_HEADLESS
+#include "Client.h"
+#endif // !TFL_HEADLESS
 #include <iterator>
 #include <future>
 
 std::map<std::string, Unit> globalUnits;
+static std::vector<Unit*> unitTable;
 
 void Unit::operator=(const std::string& name) {
     mName = name;
@@ -25,6 +31,8 @@ void Unit::operator=(const std::string& name) {
         mInfo->getVector3("releaseOffset", &mReleaseOffset);
     mSound = mInfo->getFloat("sound");
     mType = mInfo->getString("type", "army");
+    mUnitType = mType == "base" ? UnitType::base : (mType == "air" ? UnitType::air :
+        (mType == "navy" ? UnitType::navy : UnitType::army));
     auto p = mInfo->getNamespace("control", true);
     mMoveArg.x = p->getFloat("v")/1000.0f;
     mMoveArg.y =std::min(p->getFloat("RSC"),static_cast<float>(M_PI/1000.0));
@@ -33,14 +41,28 @@ void Unit::operator=(const std::string& name) {
         mMoveArg.z = 1.0f;
 }
 
-std::string Unit::getName() const {
+const std::string& Unit::getName() const {
     return mName;
 }
 
+uint16_t Unit::getID() const {
+    return mID;
+}
+
 Node* Unit::getModel() const {
+#ifdef TFL_HEADLESS
+    return getSkeleton();
+#else
     if (!mModel)
         mModel = Scene::load(("/res/units/" + mName + "/model.scene").c_str());
     return mModel->findNode("root")->clone();
+#endif // TFL_HEADLESS
+}
+
+Node* Unit::getSkeleton() const {
+    if (!mSkeleton)
+        mSkeleton = loadSkeleton("/res/units/" + mName + "/model.scene");
+    return mSkeleton->findNode("root")->clone();
 }
 
 float Unit::getHP() const {
@@ -87,14 +109,34 @@ float Unit::getSound() const {
     return mSound;
 }
 
-std::string Unit::getType() const {
+const std::string& Unit::getType() const {
     return mType;
 }
 
+UnitType Unit::getUnitType() const {
+    return mUnitType;
+}
+
 Vector3 Unit::getMoveArg() const {
     return mMoveArg;
 }
 
+bool Unit::check() const {
+    auto info = getControlInfo();
+    std::string type = info->getString("type", "");
+    auto controller = UnitController::newInstance(info);
+    if (!controller) {
+        INFO("Unit ", mName, " has an unknown controller ", type);
+        return false;
+    }
+    uniqueRAII<Node> model = getSkeleton();
+    if (!controller->bind(model.get())) {
+        INFO("The model of unit ", mName, " does not fit the controller ", type);
+        return false;
+    }
+    return true;
+}
+
 uint32_t UnitInstance::cnt = 0;
 
 Node * UnitInstance::getNode() const {
@@ -128,50 +170,19 @@ BoundingSphere UnitInstance::getBound() const {
     return { mNode->getTranslation(),mKind->getRadius() };
 }
 
-bool test(Vector2 b, Vector2 e) {
-    if (e.x<-mapSizeHF || e.x>mapSizeHF || e.y<-mapSizeHF || e.y>mapSizeHF
-        || localClient->getHeight(e.x, e.y) < 0.0f)
-        return false;
-    constexpr auto num = 16;
-    for (auto i = 1; i < num; ++i) {
-        auto p = (b*i + e*(num - i)) / num;
-        if (localClient->getHeight(p.x, p.y) < 0.0f)
-            return false;
-    }
-    return true;
-}
-
-float choose(Vector2 b, Vector2 m, Vector2 unit, float maxv) {
-    for (float i = 1.0f; i < maxv; ++i) {
-        if (test(b, m + unit*i)) return i;
-        if (test(b, m - unit*i)) return -i;
-    }
-    return maxv;
-}
-
 Vector2 UnitInstance::updateMoveTarget() {
     Vector2 mp = { mPos.x,mPos.z };
     if (mTarget.isZero() || mTarget.distanceSquared(mp) <= 16.0f)
         return mTarget = {};
-    if (test(mp, mTarget) || mPos.y <= 0.0f) 
+    auto&& map = localServer->getMap();
+    if (mPos.y <= 0.0f || map.testLine(mp, mTarget))
         return mTarget;
-    auto offset = mTarget - mp;
-    if (offset.x == 0.0f)offset.x =1.0f;
-    if (offset.y == 0.0f)offset.y =1.0f;
-    Vector3 tmp = { offset.x,0.0f,offset.y };
-    tmp.cross(Vector3::unitY());
-    Vector2 unit = { tmp.x,tmp.z };
-    unit.normalize();
-    auto dis = offset.length()*10.0f;
-    float w = 0.5f;
-    while (w >= 0.01f) {
-        auto mid = mTarget*w + mp*(1.0f - w);
-        auto p = choose(mp, mid, unit, dis);
-        if (p<dis) return mid+unit*p;
-        w*=0.618f;
-    }
-
-    return mTarget = {};
+    Vector2 way;
+    if (!map.getFlow(mp, mTarget, way))
+        way = map.findWay(mp, mTarget);
+    if (way.isZero())
+        return mTarget = {};
+    return way;
 }
 
 void UnitInstance::setAttackTarget(uint32_t id) {
@@ -196,28 +207,41 @@ UnitInstance::UnitInstance(const Unit & unit, uint8_t group, uint32_t id,
     Scene* add, bool isServer, Vector3 pos)
     :mGroup(group), mHP(unit.getHP()), mNode(nullptr), mPID(id), mKind(&unit),
     mIsServer(isServer), mLoadTarget(0), mPos(pos) {
-    mNode = unit.getModel();
+    mNode = isServer ? unit.getSkeleton() : unit.getModel();
     add->addNode(mNode.get());
     mNode->setTranslation(pos);
     mController = UnitController::newInstance(unit.getControlInfo());
+    mController->bind(mNode.get());
     if (isServer)mController->isServer();
 }
 
 void loadAllUnits() {
     std::vector<std::string> paths;
     listDirs("/res/units", paths);
+    //the infos are read on the workers while the earlier ones are parsed.
+    for (auto&& p : paths)
+        resourceLoader.prefetch("res/units/" + p + "/unit.info");
     for (auto p : paths)
         globalUnits[p] = p;
+    //a broken kind is left out instead of failing when its first unit is built.
+    for (auto i = globalUnits.begin(); i != globalUnits.end();) {
+        if (i->second.check())++i;
+        else i = globalUnits.erase(i);
+    }
+    unitTable.clear();
+    for (auto&& u : globalUnits) {
+        u.second.mID = static_cast<uint16_t>(unitTable.size());
+        unitTable.emplace_back(&u.second);
+    }
 }
 
 uint16_t getUnitID(const std::string & name) {
-    return std::distance(globalUnits.begin(), globalUnits.find(name));
+    auto i = globalUnits.find(name);
+    return i == globalUnits.cend() ? static_cast<uint16_t>(globalUnits.size()) : i->second.getID();
 }
 
 Unit & getUnit(uint16_t id) {
-    auto i = globalUnits.begin();
-    std::advance(i, id);
-    return i->second;
+    return *unitTable[id];
 }
 
 uint8_t UnitInstance::getGroup() const {
@@ -228,10 +252,18 @@ uint32_t UnitInstance::askID() {
     return ++cnt;
 }
 
+void UnitInstance::resetID() {
+    cnt = 0;
+}
+
 uint32_t UnitInstance::getAttackTarget() const {
     return mController->getAttackTarget();
 }
 
+float UnitInstance::getRange() const {
+    return mController->getRange();
+}
+
 bool UnitInstance::isDied() const {
     return mHP <= 0.0f;
 }
@@ -252,7 +284,7 @@ float UnitInstance::getHP() const {
 bool UnitInstance::tryLoad(const UnitInstance & rhs) {
     if (mLoading.size() >= mKind->getLoading() ||
         rhs.getKind().getLoading() || rhs.isDied())return false;
-    mLoading.emplace_back(getUnitID(rhs.getKind().getName()), rhs.getHP());
+    mLoading.emplace_back(rhs.getKind().getID(), rhs.getHP());
     return true;
 }
 
@@ -284,7 +316,7 @@ void UnitInstance::move(Vector2 force) const {
     if (force.y != 0.0f) fac = arg.z, mNode->rotateY(force.y*arg.y);
     if (force.x != 0.0f) {
         auto b = mPos + mNode->getDownVector().normalize()*mKind->getOffset();
-        if (b.y < localClient->getHeight(b.x, b.z)) {
+        if (b.y < getHeight(b.x, b.z)) {
             auto f = mNode->getForwardVector().normalize();
             auto base = -Vector3::unitY();
             auto fd = f.dot(base.normalize());
@@ -301,10 +333,31 @@ Vector2 UnitInstance::getAttackPos() const {
 }
 
 void UnitInstance::setAttackPos(Vector2 pos) {
-    mAttackPos = { pos.x,localClient->getHeight(pos.x,pos.y),pos.y };
+    mAttackPos = { pos.x,getHeight(pos.x,pos.y),pos.y };
     mController->setAttackTarget(pointID);
 }
 
 Vector3 UnitInstance::getPos(uint32_t& id) const {
-    return id==pointID?mAttackPos:localClient->getPos(id);
+    if (id == pointID)return mAttackPos;
+#ifndef TFL_HEADLESS
+    if (!mIsServer)return localClient->getPos(id);
+#endif // !TFL_HEADLESS
+    //the server must not read the client's units,they belong to another thread.
+    auto p = localServer->getUnitPos(id);
+    if (p.isZero())id = 0;
+    return p;
+}
+
+float UnitInstance::getHeight(float x, float z) const {
+#ifndef TFL_HEADLESS
+    if (!mIsServer)return localClient->getHeight(x, z);
+#endif // !TFL_HEADLESS
+    return localServer->getMap().getHeight(x, z);
+}
+
+void UnitInstance::getHeight(const Vector2* pos, float* res, size_t size) const {
+#ifndef TFL_HEADLESS
+    if (!mIsServer)return localClient->getHeight(pos, res, size);
+#endif // !TFL_HEADLESS
+    localServer->getMap().getHeight(pos, res, size);
 }
@@ -2,10 +2,17 @@
 #include "common.h"
 #include "UnitController.h"
 
+enum class UnitType : uint8_t {
+    army, base, air, navy
+};
+
 class Unit final {
 private:
+    friend void loadAllUnits();
+    uint16_t mID;
+    UnitType mUnitType;
     float mHP,mTime,mFOV, mRadius,mSound,mOffset;
-    mutable uniqueRAII<Scene> mModel;
+    mutable uniqueRAII<Scene> mModel, mSkeleton;
     std::string mName,mType;
     uniqueRAII<Properties> mInfo;
     Vector2 mPlane;
@@ -15,8 +22,11 @@ private:
     Vector3 mMoveArg;
 public:
     void operator=(const std::string& name);
-    std::string getName() const;
+    const std::string& getName() const;
+    uint16_t getID() const;
     Node* getModel() const;
+    //the transforms of the model without meshes,materials or particles,the server uses them.
+    Node* getSkeleton() const;
     float getHP() const;
     float getTime() const;
     float getFOV() const;
@@ -28,12 +38,16 @@ public:
     uint32_t getLoading() const;
     Vector3 getReleaseOffset() const;
     float getSound() const;
-    std::string getType() const;
+    const std::string& getType() const;
+    UnitType getUnitType() const;
     Vector3 getMoveArg() const;
+    //whether the controller named in unit.info exists and finds its nodes in the model.
+    bool check() const;
 };
 
 extern std::map<std::string,Unit> globalUnits;
 
+//fills globalUnits and the dense table indexed by the kind id.
 void loadAllUnits();
 uint16_t getUnitID(const std::string& name);
 Unit& getUnit(uint16_t id);
@@ -67,7 +81,9 @@ public:
     const Unit& getKind() const;
     void setMoveTarget(Vector2 pos);
     static uint32_t askID();
+    static void resetID();
     uint32_t getAttackTarget() const;
+    float getRange() const;
     bool isDied() const;
     Vector3 getRoughPos() const;
     void setHP(float HP);
@@ -82,6 +98,9 @@ public:
     Vector2 getAttackPos() const;
     void setAttackPos(Vector2 pos);
     Vector3 getPos(uint32_t& id) const;
+    //the terrain of the side that owns the instance.
+    float getHeight(float x, float z) const;
+    void getHeight(const Vector2* pos, float* res, size_t size) const;
     //Client
     UnitInstance(const Unit& unit, uint8_t group, uint32_t id, Scene* add, bool isServer,Vector3 pos);
     uint8_t getGroup() const;
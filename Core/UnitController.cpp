@@ -1,9 +1,16 @@
 #include "UnitController.h"
-#include "Client.h"
 #include "Server.h"
 #include <functional>
 #include <array>
 
+#ifdef TFL_HEADLESS
+//the dedicated server has no client,so no controller plays sounds there.
+#define AUDIO(...)
+#else
+#include "Client.h"
+#define AUDIO(...) localClient->getAudio().__VA_ARGS__
+#endif // TFL_HEADLESS
+
 void UnitController::setMoveTarget(Vector2 dest) { mDest = dest; }
 
 void UnitController::setAttackTarget(uint32_t id) { mObject = id; }
@@ -12,6 +19,10 @@ uint32_t UnitController::getAttackTarget() const {
     return mObject;
 }
 
+float UnitController::getRange() const {
+    return mRange;
+}
+
 bool UnitController::isStoped() const {
     return mDest.isZero();
 }
@@ -20,13 +31,24 @@ void UnitController::isServer() { mIsServer = true; }
 
 void UnitController::onDied(UnitInstance & instance) {}
 
+bool UnitController::bind(Node * node) {
+    return true;
+}
+
+Node* UnitController::findChild(Node * parent, const char * id) {
+    auto res = parent ? parent->findNode(id) : nullptr;
+    if (!res)
+        INFO("The model has no node named ", id);
+    return res;
+}
+
 void correct(UnitInstance& instance, float delta, float& cnt, float& time) {
     auto node = instance.getNode();
     auto&& kind = instance.getKind();
     auto p = node->getTranslation();
     auto offset = kind.getOffset()*node->getDownVector().normalize();
     auto b = p + offset;
-    auto h = localClient->getHeight(b.x, b.z);
+    auto h = instance.getHeight(b.x, b.z);
     if (b.y <= h) {
         {
             Vector3 pos = { b.x,h,b.z };
@@ -43,13 +65,16 @@ void correct(UnitInstance& instance, float delta, float& cnt, float& time) {
             Vector2{-d.x,d.y } ,
             Vector2{-d.x,-d.y }
         };
-        std::array<Vector3, 4> sample;
-        size_t idx = 0;
-        for (auto&&x : base) {
-            auto sp = p + r*x.x + f*x.y;
-            sample[idx] = { sp.x,localClient->getHeight(sp.x,sp.z),sp.z };
-            ++idx;
+        std::array<Vector2, 4> pos;
+        std::array<float, 4> height;
+        for (size_t i = 0; i < 4; ++i) {
+            auto sp = p + r*base[i].x + f*base[i].y;
+            pos[i] = { sp.x,sp.z };
         }
+        instance.getHeight(pos.data(), height.data(), 4);
+        std::array<Vector3, 4> sample;
+        for (size_t i = 0; i < 4; ++i)
+            sample[i] = { pos[i].x,height[i],pos[i].y };
 
         Vector3 mean;
         for (size_t i = 0; i < 4; ++i) {
@@ -82,12 +107,22 @@ auto dot(Node* node, Vector2 obj) {
     return obj.dot(x.normalize());
 }
 
-auto checkRay(Vector3 begin, Vector3 end) {
+auto checkRay(const UnitInstance& instance, Vector3 begin, Vector3 end) {
     constexpr auto unit = 20.0f;
+    constexpr auto batch = 16;
     int step = begin.distance(end) / unit + 1;
-    for (int w = step - 1; w > 0; --w) {
-        auto p = (begin*w + end*(step - w)) / step;
-        if (localClient->getHeight(p.x, p.z) > p.y)return p;
+    std::array<Vector3, batch> point;
+    std::array<Vector2, batch> pos;
+    std::array<float, batch> height;
+    for (int w = step - 1; w > 0; w -= batch) {
+        auto num = std::min(w, batch);
+        for (auto i = 0; i < num; ++i) {
+            point[i] = (begin*(w - i) + end*(step - w + i)) / step;
+            pos[i] = { point[i].x,point[i].z };
+        }
+        instance.getHeight(pos.data(), height.data(), num);
+        for (auto i = 0; i < num; ++i)
+            if (height[i] > point[i].y)return point[i];
     }
     return end;
 }
@@ -138,6 +173,7 @@ void scale(UnitInstance& instance, float& sy, float& x, float delta, float m = 0
 
 #define Init(name) name(info->getFloat(#name))
 struct Tank final :public UnitController {
+    Node *yr = nullptr, *turret = nullptr;
     float RST, RSC, v, time, harm, dis, rfac, sample, range, offset, speed, fcnt, x, sy, bt;
     Vector2 last;
     std::string bullet;
@@ -161,6 +197,12 @@ struct Tank final :public UnitController {
         }
     }
 
+    bool bind(Node* node) override {
+        yr = findChild(node, "yr");
+        turret = findChild(yr, "turret");
+        return turret;
+    }
+
     bool update(UnitInstance& instance, float delta) override {
 
         scale(instance, sy, x, delta);
@@ -176,8 +218,7 @@ struct Tank final :public UnitController {
         }
 
         auto c = node;
-        auto yr = node->findNode("yr");
-        auto t = yr->findNode("turret");
+        auto t = turret;
         auto point = instance.getPos(mObject);
         auto now = node->getTranslation();
         Vector2 np{ now.x,now.z };
@@ -198,10 +239,10 @@ struct Tank final :public UnitController {
             if (!mIsServer) {
                 for (auto&& x : fireUnits)
                     if (x.z >= time) {
-                        localClient->getAudio().voice(StateType::ready, instance.getID(), now);
+                        AUDIO(voice(StateType::ready, instance.getID(), now));
                     }
                 if (mObject && obj.lengthSquared() <= dis)
-                    localClient->getAudio().voice(StateType::in, instance.getID(), now, { mObject });
+                    AUDIO(voice(StateType::in, instance.getID(), now, { mObject }));
             }
 
             if (d > 0.996f && obj.lengthSquared() <= dis) {
@@ -221,8 +262,8 @@ struct Tank final :public UnitController {
                             offset*f + u*iter->y + r*iter->x, point, f, speed, harm, range, instance.getGroup()));
                     }
                     else {
-                        localClient->getAudio().voice(StateType::fire, instance.getID(), now);
-                        localClient->getAudio().play(AudioType::fire, now);
+                        AUDIO(voice(StateType::fire, instance.getID(), now));
+                        AUDIO(play(AudioType::fire, now));
                     }
                     t->translateForward(bt);
                     t->translateForward(-(bt = 20.0f));
@@ -254,6 +295,7 @@ struct Tank final :public UnitController {
 };
 
 struct DET final :public UnitController {
+    Node *yr = nullptr, *xr = nullptr, *ray = nullptr;
     float RSC, RSX, RSY, harm, dis, v, rfac, x, sy, fcnt, count, sample, add, sub, max, st, time;
     Vector2 last;
     DET(const Properties* info) :Init(RSC), Init(RSX), Init(RSY), Init(harm), Init(dis), Init(add), Init(v), Init(rfac)
@@ -263,6 +305,13 @@ struct DET final :public UnitController {
         dis *= dis;
     }
 
+    bool bind(Node* node) override {
+        yr = findChild(node, "yr");
+        xr = findChild(yr, "xr");
+        ray = findChild(xr, "ray");
+        return ray;
+    }
+
     bool update(UnitInstance& instance, float delta) override {
 
         scale(instance, sy, x, delta);
@@ -276,8 +325,8 @@ struct DET final :public UnitController {
         count = std::min(count, max);
 
         auto c = node;
-        auto ty = node->findNode("yr");
-        auto t = ty->findNode("xr");
+        auto ty = yr;
+        auto t = xr;
         auto point = instance.getPos(mObject);
         auto now = node->getTranslation();
         Vector2 np{ now.x,now.z };
@@ -306,17 +355,16 @@ struct DET final :public UnitController {
             correctVector(t, &Node::getForwardVectorWorld, f, RSX*delta, 0.0f, 0.0f);
         }
 
-        auto ray = t->findNode("ray");
         auto p = t->getTranslationWorld();
 
         if (count >= sub)
             time += st, count -= sub;
 
         if (!mIsServer&& mObject && p.distanceSquared(point) <= dis)
-            localClient->getAudio().voice(StateType::in, instance.getID(), p, { mObject });
+            AUDIO(voice(StateType::in, instance.getID(), p, { mObject }));
 
         if (time >= delta && !point.isZero() && d > 0.999f && p.distanceSquared(point) <= dis) {
-            auto end = checkRay(p, point);
+            auto end = checkRay(instance, p, point);
             if (mIsServer) {
                 if (end == point)
                     localServer->attack(mObject, delta*harm);
@@ -333,11 +381,12 @@ struct DET final :public UnitController {
         return move(instance, mDest, np, c, RSC, delta, rfac, v, sample, fcnt, x);
     }
     void onDied(UnitInstance& instance) override {
-        instance.getNode()->findNode("ray")->setEnabled(false);
+        ray->setEnabled(false);
     }
 };
 
 struct CBM final :public UnitController {
+    Node *missileNode = nullptr;
     float RSC, rfac, time, sy, x, fcnt, count, sample, v, range, harm, speed, angle, dis;
     Vector2 last;
     std::string missile;
@@ -348,6 +397,11 @@ struct CBM final :public UnitController {
         time *= 1000.0f;
         dis *= dis;
     }
+    bool bind(Node* node) override {
+        missileNode = findChild(node, "missile");
+        return missileNode;
+    }
+
     bool update(UnitInstance& instance, float delta) override {
 
         scale(instance, sy, x, delta, 0.9f);
@@ -374,21 +428,21 @@ struct CBM final :public UnitController {
         }
 
         if (!mIsServer) {
-            node->findNode("missile")->setEnabled(count >= time*0.8f);
+            missileNode->setEnabled(count >= time*0.8f);
             if (count >= time)
-                localClient->getAudio().voice(StateType::ready, instance.getID(), now);
+                AUDIO(voice(StateType::ready, instance.getID(), now));
             if (mObject && now.distanceSquared(point) <= dis)
-                localClient->getAudio().voice(StateType::in, instance.getID(), now, { mObject });
+                AUDIO(voice(StateType::in, instance.getID(), now, { mObject }));
         }
 
         if (mObject && count >= time && now.distanceSquared(point) <= dis) {
             if (mIsServer) {
-                auto m = node->findNode("missile");
+                auto m = missileNode;
                 localServer->newBullet(BulletInstance(missile, m->getTranslationWorld(), point,
                     m->getForwardVectorWorld().normalize(), speed, harm, range, instance.getGroup()
                     , mObject, angle));
             }
-            else localClient->getAudio().voice(StateType::fire, instance.getID(), now);
+            else AUDIO(voice(StateType::fire, instance.getID(), now));
             count = 0.0f;
         }
 
@@ -397,6 +451,7 @@ struct CBM final :public UnitController {
 };
 
 struct CBR final :public UnitController {
+    Node *radar = nullptr;
     float RSC, rfac, sy, x, fcnt, sample, v, harm;
     Vector2 last;
     CBR(const Properties* info) :Init(RSC), Init(rfac), sy(0.0f), x(0.0f), fcnt(0.0f),
@@ -404,6 +459,11 @@ struct CBR final :public UnitController {
         v /= 1000.0f;
         harm /= 1000.0f;
     }
+    bool bind(Node* node) override {
+        radar = findChild(node, "radar");
+        return radar;
+    }
+
     bool update(UnitInstance& instance, float delta) override {
 
         scale(instance, sy, x, delta, 0.9f);
@@ -433,13 +493,14 @@ struct CBR final :public UnitController {
             localServer->attack(mObject, delta*harm*fov / d);
         }
 
-        node->findNode("radar")->rotateY(M_PI*2.0f / 1000.0f*delta);
+        radar->rotateY(M_PI*2.0f / 1000.0f*delta);
 
         return move(instance, mDest, np, c, RSC, delta, rfac, v, sample, fcnt, x, -1.0f);
     }
 };
 
 struct CBG final :public UnitController {
+    Node *yr = nullptr, *xr = nullptr;
     float RSC, RSX, RSY, harm, dis, v, rfac, x, sy, fcnt, count, sample, time, range, speed, offset, bt;
     Vector2 last;
     std::string bullet;
@@ -453,6 +514,12 @@ struct CBG final :public UnitController {
         time *= 1000.0f;
     }
 
+    bool bind(Node* node) override {
+        yr = findChild(node, "yr");
+        xr = findChild(yr, "xr");
+        return xr;
+    }
+
     bool update(UnitInstance& instance, float delta) override {
 
         scale(instance, sy, x, delta);
@@ -466,8 +533,8 @@ struct CBG final :public UnitController {
         count = std::min(count, time + 1.0f);
 
         auto c = node;
-        auto ty = node->findNode("yr");
-        auto t = ty->findNode("xr");
+        auto ty = yr;
+        auto t = xr;
         auto point = instance.getPos(mObject);
         auto now = node->getTranslation();
         Vector2 np{ now.x,now.z };
@@ -489,13 +556,13 @@ struct CBG final :public UnitController {
             }
             auto f = t->getForwardVectorWorld().normalize();
             if (count >= time && obj.lengthSquared() <= dis &&
-                obj.dot(f) >= 0.996f && checkRay(now, point) == point && bt <= 30.0f) {
+                obj.dot(f) >= 0.996f && checkRay(instance, now, point) == point && bt <= 30.0f) {
                 if (mIsServer)
                     localServer->newBullet(BulletInstance(bullet, t->getTranslationWorld() +
                         offset*f, point, f, speed, harm, range, instance.getGroup()));
                 else {
-                    localClient->getAudio().voice(StateType::fire, instance.getID(), now);
-                    localClient->getAudio().play(AudioType::fire, now);
+                    AUDIO(voice(StateType::fire, instance.getID(), now));
+                    AUDIO(play(AudioType::fire, now));
                 }
 
                 count = 0.0f;
@@ -526,7 +593,7 @@ struct CBG final :public UnitController {
 };
 
 void fly(UnitInstance& instance, Vector2 dest, float h, float v, float delta, float RSC, Vector3 now) {
-    h += std::max(localClient->getHeight(now.x, now.z), 0.0f);
+    h += std::max(instance.getHeight(now.x, now.z), 0.0f);
 
     if (now.y < h - 50.0f && dest.isZero())
         dest = { now.x,now.z };
@@ -552,7 +619,7 @@ void fly(UnitInstance& instance, Vector2 dest, float h, float v, float delta, fl
 void fall(UnitInstance& instance, float delta) {
     auto node = instance.getNode();
     auto pos = instance.getRoughPos();
-    if (pos.y - localClient->getHeight(pos.x, pos.z) < 15.0f)return;
+    if (pos.y - instance.getHeight(pos.x, pos.z) < 15.0f)return;
     constexpr auto RSF = 0.005f;
     std::uniform_real_distribution<float> URD(0.0f, RSF*delta);
     node->rotateX(URD(mt));
@@ -588,9 +655,9 @@ struct PBM final :public UnitController {
 
         if (!mIsServer) {
             if (count >= time)
-                localClient->getAudio().voice(StateType::ready, instance.getID(), now);
+                AUDIO(voice(StateType::ready, instance.getID(), now));
             if (in)
-                localClient->getAudio().voice(StateType::in, instance.getID(), now, { mObject });
+                AUDIO(voice(StateType::in, instance.getID(), now, { mObject }));
             if (count >= time && in)
                 count = 0.0f;
         }
@@ -628,7 +695,7 @@ struct TP final :public UnitController {
 
         if (mIsServer) {
             if (!mDest.isZero()) {
-                if (localClient->getHeight(mDest.x, mDest.y) < 0.0f)
+                if (instance.getHeight(mDest.x, mDest.y) < 0.0f)
                     mDest = Vector2::zero();
                 auto node = instance.getNode();
                 auto c = node;
@@ -642,7 +709,7 @@ struct TP final :public UnitController {
                 }
                 else {
                     auto dis = mDest.distanceSquared({ now.x,now.z });
-                    auto flag = now.y - localClient->getHeight(now.x, now.z) < instance.getKind().getRadius();
+                    auto flag = now.y - instance.getHeight(now.x, now.z) < instance.getKind().getRadius();
                     if (flag && dis < 2.5e5f) {
                         mDest = Vector2::zero();
                         correct(instance, delta, fcnt, x);
@@ -650,7 +717,7 @@ struct TP final :public UnitController {
                     else {
                         auto h = std::pow(std::min(dis / 9e6f, 1.0f), 0.25f)*height;
                         fly(instance, mDest, h, v, delta, RSC, now);
-                        h += std::max(localClient->getHeight(now.x, now.z), 0.0f);
+                        h += std::max(instance.getHeight(now.x, now.z), 0.0f);
                         if (h < node->getTranslationY()) {
                             auto p = node->getTranslation();
                             node->translateSmooth({ p.x,h,p.y }, delta, 100.0f);
@@ -672,6 +739,7 @@ struct TP final :public UnitController {
 };
 
 struct Copter final :public UnitController {
+    Node *upNode = nullptr, *rotateNode = nullptr;
     float RSC, v, height, dis, time, offset, count[2], fcnt, harm, range, speed, ry, sy, x;
     std::string missile;
     Vector3 last;
@@ -685,6 +753,12 @@ struct Copter final :public UnitController {
         count[0] = count[1] = 0.0f;
     }
 
+    bool bind(Node* node) override {
+        upNode = findChild(node, "up");
+        rotateNode = findChild(node, "rotate");
+        return upNode && rotateNode;
+    }
+
     bool update(UnitInstance& instance, float delta) override {
 
         scale(instance, sy, x, delta);
@@ -696,8 +770,8 @@ struct Copter final :public UnitController {
         if (instance.isDied()) {
             fall(instance, delta);
             ry *= w;
-            node->findNode("up")->rotateY(ry);
-            node->findNode("rotate")->rotateY(ry);
+            upNode->rotateY(ry);
+            rotateNode->rotateY(ry);
             correct(instance, delta, fcnt, x);
             return false;
         }
@@ -708,7 +782,7 @@ struct Copter final :public UnitController {
         for (auto i = 0; i < 2; ++i)
             count[i] = std::min(count[i] + delta, time + 0.1f);
 
-        auto h = localClient->getHeight(now.x, now.z);
+        auto h = instance.getHeight(now.x, now.z);
 
         if (mObject) {
             auto f = node->getForwardVector().normalize();
@@ -735,13 +809,13 @@ struct Copter final :public UnitController {
                 }
             }
             else {
-                if (in)localClient->getAudio().voice(StateType::in, instance.getID(), now, { mObject });
-                if (ready)localClient->getAudio().voice(StateType::ready, instance.getID(), now);
+                if (in)AUDIO(voice(StateType::in, instance.getID(), now, { mObject }));
+                if (ready)AUDIO(voice(StateType::ready, instance.getID(), now));
                 if (in&&ready) {
                     for (auto i = 0; i < 2; ++i)
                         if (count[i] >= time) {
                             count[i] = 0.0f;
-                            localClient->getAudio().voice(StateType::fire, instance.getID(), now);
+                            AUDIO(voice(StateType::fire, instance.getID(), now));
                         }
                 }
             }
@@ -778,9 +852,9 @@ struct Copter final :public UnitController {
             auto dis = last.isZero() ? 0.0f : last.distanceSquared(now);
             constexpr auto fac = 0.005f;
             ry = ry*w + (up + dis)*fac*(1.0f - w);
-            node->findNode("up")->rotateY(ry);
+            upNode->rotateY(ry);
             last = now;
-            node->findNode("rotate")->rotateY(ry);
+            rotateNode->rotateY(ry);
         }
 
         return true;
@@ -788,6 +862,7 @@ struct Copter final :public UnitController {
 };
 
 struct Submarine final :public UnitController {
+    Node *push = nullptr;
     float RSC, height, v, dis, time, harm, range, speed, fcnt, lfac, count;
     std::string bullet, missile;
     Vector3 last;
@@ -798,6 +873,11 @@ struct Submarine final :public UnitController {
         v /= 1000.0f;
         dis *= dis;
     }
+    bool bind(Node* node) override {
+        push = findChild(node, "push");
+        return push;
+    }
+
     bool update(UnitInstance& instance, float delta) override {
 
         if (instance.isDied()) {
@@ -816,12 +896,12 @@ struct Submarine final :public UnitController {
             bool in = point.distanceSquared(now) <= dis;
             if (!mIsServer) {
                 if (in)
-                    localClient->getAudio().voice(StateType::in, instance.getID(), now, { mObject });
+                    AUDIO(voice(StateType::in, instance.getID(), now, { mObject }));
                 if (count >= time)
-                    localClient->getAudio().voice(StateType::ready, instance.getID(), now);
+                    AUDIO(voice(StateType::ready, instance.getID(), now));
                 if (in && count >= time) {
                     count = 0.0f;
-                    localClient->getAudio().voice(StateType::fire, instance.getID(), now);
+                    AUDIO(voice(StateType::fire, instance.getID(), now));
                 }
             }
             else if (in && count >= time) {
@@ -847,14 +927,14 @@ struct Submarine final :public UnitController {
                 mDest = Vector2::zero();
             else {
                 if (now.y >= 0.0f) {
-                    Vector3 pos{ mDest.x,localClient->getHeight(mDest.x,mDest.y),mDest.y };
+                    Vector3 pos{ mDest.x,instance.getHeight(mDest.x,mDest.y),mDest.y };
                     auto offset = pos - now;
                     correctVector(node, &Node::getForwardVector, offset.normalize()
                         , RSC*delta, RSC*delta, 0.0f);
                     node->translateForward(v*delta*lfac);
                 }
                 else {
-                    auto h = localClient->getHeight(mDest.x, mDest.y);
+                    auto h = instance.getHeight(mDest.x, mDest.y);
                     Vector3 pos{ mDest.x,h > 0.0f ? h : h*height,mDest.y };
                     auto offset = pos - now;
                     correctVector(node, &Node::getForwardVector, offset.normalize()
@@ -870,7 +950,7 @@ struct Submarine final :public UnitController {
 
         if (!mIsServer) {
             auto d = last.distance(now);
-            node->findNode("push")->rotateZ(d*delta);
+            push->rotateZ(d*delta);
             last = now;
         }
         return false;
@@ -878,6 +958,7 @@ struct Submarine final :public UnitController {
 };
 
 struct Ship final :public UnitController {
+    Node *turret = nullptr;
     float RSC, RST, btime, v, dis, time, harm, range, speed, fcnt, lfac, bcnt, mcnt, offset;
     std::string bullet, missile;
     Ship(const Properties* info) :Init(RSC), Init(RST), Init(btime), Init(v), Init(dis), Init(time), Init(offset),
@@ -888,6 +969,11 @@ struct Ship final :public UnitController {
         v /= 1000.0f;
         dis *= dis;
     }
+    bool bind(Node* node) override {
+        turret = findChild(node, "turret");
+        return turret;
+    }
+
     bool update(UnitInstance& instance, float delta) override {
 
         if (instance.isDied()) {
@@ -897,7 +983,7 @@ struct Ship final :public UnitController {
         }
 
         auto node = instance.getNode();
-        auto t = node->findNode("turret");
+        auto t = turret;
         auto now = instance.getNode()->getTranslation();
 
         bcnt = std::min(bcnt + delta, btime + 0.1f);
@@ -917,12 +1003,12 @@ struct Ship final :public UnitController {
             }
             if (!mIsServer) {
                 if (in)
-                    localClient->getAudio().voice(StateType::in, instance.getID(), now, { mObject });
+                    AUDIO(voice(StateType::in, instance.getID(), now, { mObject }));
                 if (bcnt >= btime || mcnt >= time)
-                    localClient->getAudio().voice(StateType::ready, instance.getID(), now);
+                    AUDIO(voice(StateType::ready, instance.getID(), now));
                 if (in && bcnt >= btime && d > 0.996f) {
                     bcnt = 0.0f;
-                    localClient->getAudio().voice(StateType::fire, instance.getID(), now);
+                    AUDIO(voice(StateType::fire, instance.getID(), now));
                 }
             }
             else if (in) {
@@ -955,7 +1041,7 @@ struct Ship final :public UnitController {
             if (mDest.distanceSquared({ now.x,now.z }) < 1e3f)
                 mDest = Vector2::zero();
             else {
-                auto h = localClient->getHeight(now.x, now.y);
+                auto h = instance.getHeight(now.x, now.y);
                 Vector3 pos{ mDest.x,std::max(h,0.0f),mDest.y };
                 auto offset = pos - now;
 
@@ -998,5 +1084,11 @@ void UnitController::initAllController() {
 }
 
 std::unique_ptr<UnitController> UnitController::newInstance(const Properties * info) {
-    return factory[info->getString("type")](info);
+    auto i = factory.find(info->getString("type", ""));
+    if (i == factory.cend())return nullptr;
+    auto res = i->second(info);
+    res->mRange = info->getFloat("dis");
+    return res;
 }
+
+#undef AUDIO
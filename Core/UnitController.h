@@ -7,16 +7,25 @@ class UnitInstance;
 class UnitController {
 public:
     static void initAllController();
+    //nullptr when the type of the control namespace names no controller.
     static std::unique_ptr<UnitController>  newInstance(const Properties* info);
+    virtual ~UnitController() = default;
     void setMoveTarget(Vector2 dest);
     void setAttackTarget(uint32_t id);
     uint32_t getAttackTarget() const;
+    //the distance the unit fires at,0 when it has no weapon.
+    float getRange() const;
     bool isStoped() const;
     void isServer();
     virtual bool update(UnitInstance& instance,float delta) = 0;
     virtual void onDied(UnitInstance& instance);
+    //resolves the child nodes of the model once,the updates use the handles directly.
+    //returns false when the model lacks one of them.
+    virtual bool bind(Node* node);
 protected:
+    static Node* findChild(Node* parent, const char* id);
     uint32_t mObject=0;
     Vector2 mDest=Vector2::zero();
     bool mIsServer=false;
+    float mRange=0.0f;
 };
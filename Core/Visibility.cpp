@@ -0,0 +1,95 @@
+#include "Visibility.h"
+
+Visibility::Coverage::Coverage() {
+    for (auto i = 0; i < layerNum; ++i) {
+        diff[i].resize(size*(size + 1), 0);
+        visible[i].resize(size*size, 0);
+        dirty[i].resize(size, 0);
+    }
+}
+
+int Visibility::toCell(float x) {
+    auto c = static_cast<int>((x + mapSizeHF) / cellSize);
+    return std::min(std::max(c, 0), size - 1);
+}
+
+void Visibility::stamp(const Stamp& s, int sign) {
+    auto&& cover = mGroups[s.group];
+    for (auto i = 0; i < layerNum; ++i) {
+        auto r = s.radius[i];
+        if (r <= 0.0f)continue;
+        auto&& diff = cover.diff[i];
+        auto&& dirty = cover.dirty[i];
+        //cells whose centers are in the circle around the center of the cell of the unit.
+        auto rows = static_cast<int>(std::min(r / cellSize, static_cast<float>(size)));
+        auto z0 = std::max(s.cz - rows, 0), z1 = std::min(s.cz + rows, size - 1);
+        for (auto z = z0; z <= z1; ++z) {
+            auto dz = (z - s.cz)*cellSize;
+            auto w = static_cast<int>(std::min(std::sqrt(std::max(r*r - dz*dz, 0.0f)) / cellSize,
+                static_cast<float>(size)));
+            auto x0 = std::max(s.cx - w, 0), x1 = std::min(s.cx + w, size - 1);
+            auto row = z*(size + 1);
+            diff[row + x0] += sign;
+            diff[row + x1 + 1] -= sign;
+            dirty[z] = 1;
+        }
+    }
+}
+
+Visibility::Visibility() :mTick(0) {}
+
+void Visibility::update(uint32_t id, uint8_t group, Vector3 pos, float fov, float hearing) {
+    Stamp s{ group,toCell(pos.x),toCell(pos.z),{ fov,hearing },mTick };
+    auto i = mStamps.find(id);
+    if (i != mStamps.cend()) {
+        auto&& old = i->second;
+        old.tick = mTick;
+        if (old.group == s.group && old.cx == s.cx && old.cz == s.cz
+            && old.radius[sight] == s.radius[sight] && old.radius[sound] == s.radius[sound])
+            return;
+        stamp(old, -1);
+        old = s;
+    }
+    else
+        mStamps.insert({ id,s });
+    stamp(s, 1);
+}
+
+void Visibility::finish() {
+    for (auto i = mStamps.begin(); i != mStamps.end();)
+        if (i->second.tick != mTick) {
+            stamp(i->second, -1);
+            i = mStamps.erase(i);
+        }
+        else ++i;
+    ++mTick;
+
+    for (auto&& g : mGroups)
+        for (auto i = 0; i < layerNum; ++i) {
+            auto&& cover = g.second;
+            for (auto z = 0; z < size; ++z) {
+                if (!cover.dirty[i][z])continue;
+                cover.dirty[i][z] = 0;
+                auto diff = cover.diff[i].data() + z*(size + 1);
+                auto visible = cover.visible[i].data() + z*size;
+                int32_t sum = 0;
+                for (auto x = 0; x < size; ++x) {
+                    sum += diff[x];
+                    visible[x] = sum > 0;
+                }
+            }
+        }
+}
+
+void Visibility::clear() {
+    mGroups.clear();
+    mStamps.clear();
+    mTick = 0;
+}
+
+bool Visibility::isVisible(uint8_t group, Vector3 pos) const {
+    auto i = mGroups.find(group);
+    if (i == mGroups.cend())return false;
+    auto layer = pos.y >= 0.0f ? sight : sound;
+    return i->second.visible[layer][toCell(pos.z)*size + toCell(pos.x)];
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "common.h"
+#include <unordered_map>
+
+//the cells of the map that each group can see(sight layer) or hear underwater(sound layer).
+//a unit stamps one span per row of its circles into a difference array,and is restamped only
+//when it enters another cell,so the bitmaps are rebuilt from the rows that changed.
+class Visibility final {
+public:
+    static constexpr auto cellSize = 100.0f;
+    static constexpr auto size = static_cast<int>(mapSizeF / cellSize) + 1;
+private:
+    enum Layer {
+        sight, sound, layerNum
+    };
+    struct Coverage final {
+        std::vector<int32_t> diff[layerNum];
+        std::vector<uint8_t> visible[layerNum];
+        std::vector<uint8_t> dirty[layerNum];
+        Coverage();
+    };
+    struct Stamp final {
+        uint8_t group;
+        int cx, cz;
+        float radius[layerNum];
+        uint32_t tick;
+    };
+    std::unordered_map<uint8_t, Coverage> mGroups;
+    std::unordered_map<uint32_t, Stamp> mStamps;
+    uint32_t mTick;
+
+    static int toCell(float x);
+    void stamp(const Stamp& s, int sign);
+public:
+    Visibility();
+    //radii are distances,a unit that is not updated during a tick is removed by finish.
+    void update(uint32_t id, uint8_t group, Vector3 pos, float fov, float hearing);
+    void finish();
+    void clear();
+    //positions above the water are seen,the ones below are heard.
+    bool isVisible(uint8_t group, Vector3 pos) const;
+};
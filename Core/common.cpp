@@ -1,6 +1,7 @@
 #include "common.h"
+#include "Pak.h"
 
-bool listDirs(const char* dirPath, std::vector<std::string>& dirs) {
+static bool listDiskDirs(const char* dirPath, std::vector<std::string>& dirs) {
 #ifdef WIN32
     std::string path(FileSystem::getResourcePath());
     if (dirPath && strlen(dirPath) > 0) {
@@ -65,6 +66,17 @@ bool listDirs(const char* dirPath, std::vector<std::string>& dirs) {
 #endif
 }
 
+bool listDirs(const char* dirPath, std::vector<std::string>& dirs) {
+    auto mounted = pakFileSystem.listDirs(dirPath, dirs);
+    auto count = dirs.size();
+    auto result = listDiskDirs(dirPath, dirs);
+    //a directory may be both in a pak and on disk.
+    auto end = dirs.begin() + count;
+    dirs.erase(std::remove_if(dirs.begin() + count, dirs.end(),
+        [&](const std::string& name) {return std::find(dirs.begin(), end, name) != end; }), dirs.end());
+    return mounted || result;
+}
+
 void removeAll(const std::string & path) {
     {
         std::vector<std::string> files;
@@ -82,39 +94,85 @@ void removeAll(const std::string & path) {
     rmdir(path.c_str());
 }
 
+namespace {
+    struct SamplerInfo final {
+        Vector3(Node::*sampler)() const;
+        Vector3 axis;
+        bool world;
+    };
+
+    //the signed angle around k that turns from to the projection of to on the plane of k.
+    float angleAround(const Vector3& k, const Vector3& from, Vector3 to) {
+        to -= k*k.dot(to);
+        Vector3 c;
+        Vector3::cross(from, to, &c);
+        return std::atan2(k.dot(c), from.dot(to));
+    }
+}
+
 void correctVector(Node * node, Vector3(Node::* sampler)() const, Vector3 dest
     , float X, float Y, float Z) {
-    auto unit = 1.0f;
-    auto dot = [&] {
-        auto vec = (node->*sampler)().normalize();
-        return vec.dot(dest);
+    static const SamplerInfo samplers[] = {
+        { &Node::getForwardVector,-Vector3::unitZ(),false },
+        { &Node::getBackVector,Vector3::unitZ(),false },
+        { &Node::getUpVector,Vector3::unitY(),false },
+        { &Node::getDownVector,-Vector3::unitY(),false },
+        { &Node::getLeftVector,-Vector3::unitX(),false },
+        { &Node::getRightVector,Vector3::unitX(),false },
+        { &Node::getForwardVectorWorld,-Vector3::unitZ(),true },
+        { &Node::getRightVectorWorld,Vector3::unitX(),true },
+        { &Node::getUpVectorWorld,Vector3::unitY(),true }
     };
-    auto cd = dot();
-    if (cd > 0.9999f)return;
-    float cntX=0.0f, cntY=0.0f, cntZ=0.0f;
-    for (auto unit = std::max({ X,Y,Z }); unit > 0.00005f; unit /= 2.0f) {
-#define TEST(a,b) \
-        while (std::abs(cnt##a+(b))<a) {\
-            node->rotate##a((b));\
-            auto nd = dot();\
-            if (cd < nd)cd = nd,cnt##a+=(b);\
-            else {\
-                  node->rotate##a(-(b));\
-                  break;\
-            }\
-        }\
-
-        TEST(X, unit);
-        TEST(X, -unit);
-        TEST(Y, unit);
-        TEST(Y, -unit);
-        TEST(Z, unit);
-        TEST(Z, -unit);
-#undef TEST
+    auto info = std::find_if(std::begin(samplers), std::end(samplers),
+        [sampler](const SamplerInfo& x) {return x.sampler == sampler; });
+    if (info == std::end(samplers)) {
+        INFO("correctVector:unknown sampler");
+        return;
+    }
+
+    //work in the local space of the node,the sampled vector is one of its axes there.
+    Quaternion rotation;
+    if (info->world)node->getWorldMatrix().getRotation(&rotation);
+    else rotation = node->getRotation();
+    Matrix inv;
+    Matrix::createRotation(rotation, &inv);
+    inv.transpose();
+    Vector3 d;
+    inv.transformVector(dest.normalize(), &d);
+    auto&& a = info->axis;
+    if (a.dot(d) > 0.9999f)return;
+
+    //rotations around the sampled axis itself change nothing,the larger axis is applied first.
+    const float limit[3] = { X,Y,Z };
+    const Vector3 axes[3] = { Vector3::unitX(),Vector3::unitY(),Vector3::unitZ() };
+    int used[2], cnt = 0;
+    for (auto i = 2; i >= 0 && cnt < 2; --i)
+        if (limit[i] > 0.0f && std::abs(axes[i].dot(a)) < 0.5f)
+            used[cnt++] = i;
+    auto clamp = [&limit](float x, int i) {return std::min(std::max(x, -limit[i]), limit[i]); };
+
+    Quaternion res;
+    if (cnt == 1) {
+        auto&& k = axes[used[0]];
+        Quaternion::createFromAxisAngle(k, clamp(angleAround(k, a, d), used[0]), &res);
+    }
+    else if (cnt == 2) {
+        //the inner rotation sets the component along the outer axis,the outer one turns the rest.
+        auto&& k1 = axes[used[0]];
+        auto&& k2 = axes[used[1]];
+        Vector3 c;
+        Vector3::cross(k2, a, &c);
+        auto s = std::min(std::max(d.dot(k1)*c.dot(k1), -1.0f), 1.0f);
+        Quaternion outer, inner;
+        Quaternion::createFromAxisAngle(k1, clamp(angleAround(k1, a, d), used[0]), &outer);
+        Quaternion::createFromAxisAngle(k2, clamp(std::asin(s), used[1]), &inner);
+        res = outer*inner;
     }
+    else return;
+    node->rotate(res);
 }
 
-std::mt19937_64 mt(std::chrono::high_resolution_clock::now().time_since_epoch().count());
+thread_local std::mt19937_64 mt(std::chrono::high_resolution_clock::now().time_since_epoch().count());
 
 uint16_t shadowSize=1;
 bool enableParticle = false;
@@ -122,3 +180,4 @@ float bias = 0.0025f;
 uint16_t miniMapSize = 0;
 float waterAlpha = 0.5f;
 float reflection = 0.0f;
+float interpolationDelay = 100.0f;
@@ -15,6 +15,7 @@
 #else
 #include <dirent.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #define MKDIR(x) mkdir((x),0777)
 #endif
 
@@ -67,7 +68,8 @@ void nativeSwap(T& a, T& b) {
     std::memmove(&b, tmp, sizeof(T));
 }
 
-extern std::mt19937_64 mt;
+//each thread owns its generator,the server simulates on its own thread.
+extern thread_local std::mt19937_64 mt;
 class Client;
 extern std::unique_ptr<Client> localClient;
 
@@ -103,3 +105,4 @@ extern float bias;
 extern uint16_t miniMapSize;
 extern float waterAlpha;
 extern float reflection;
+extern float interpolationDelay;
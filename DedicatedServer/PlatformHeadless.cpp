@@ -0,0 +1,21 @@
+//the parts of the engine's platform layer that the trimmed engine of the Linux server still references.
+//the server never creates a Game,a window or a GL context.
+#ifdef __linux__
+#include "Base.h"
+#include "Game.h"
+#include <cstdarg>
+
+namespace gameplay {
+    extern void print(const char* format, ...) {
+        va_list args;
+        va_start(args, format);
+        vfprintf(stderr, format, args);
+        va_end(args);
+    }
+
+    //Game.cpp is not compiled,there is no instance like before a Game is constructed.
+    Game* Game::getInstance() {
+        return NULL;
+    }
+}
+#endif // __linux__
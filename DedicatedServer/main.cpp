@@ -0,0 +1,120 @@
+//Headless server,built with TFL_HEADLESS so it needs no renderer or audio device.
+#include <iostream>
+#include <string>
+#include <thread>
+#include "../Core/Server.h"
+#include "../Core/Message.h"
+#include "../Core/Pak.h"
+#include "../Core/Loader.h"
+using namespace std::literals;
+
+uint64_t pakKey = 0;
+
+void logCallback(Logger::Level, const char* message) {
+    std::cout << message << std::flush;
+}
+
+//The indexed paks are mounted,the old ones must have been unpacked by the game.
+void mountPaks() {
+    for (auto&& p : listPaks()) {
+        if (!p.local)pakKey ^= p.key;
+        if (p.indexed)
+            pakFileSystem.mount("paks/" + p.name);
+        else
+            INFO("The pak ", p.name, " is not indexed,its files are read from res.");
+    }
+    resourceLoader.setNext(&pakFileSystem);
+    FileSystem::setProvider(&resourceLoader);
+}
+
+bool ready(const std::map<RakNet::SystemAddress, ClientInfo>& clients, size_t players) {
+    if (clients.size() < players)return false;
+    if (players < 2)return true;
+    auto group = clients.begin()->second.group;
+    for (auto&& c : clients)
+        if (c.second.group != group)
+            return true;
+    return false;
+}
+
+//serves a recorded match to the first client that connects.
+int play(const std::string& path, float speed, uint32_t from) {
+    ReplayPlayer player(path);
+    if (!player.isValid())return 1;
+    player.changeSpeed(speed);
+    if (!player.seek(from))return 1;
+    INFO("Waiting for the viewer.");
+    while (!player.waitClient())
+        std::this_thread::sleep_for(10ms);
+    using clock = std::chrono::steady_clock;
+    auto last = clock::now();
+    do {
+        std::this_thread::sleep_for(16ms);
+        auto now = clock::now();
+        auto delta = std::chrono::duration<float, std::milli>(now - last).count();
+        last = now;
+        if (!player.update(delta))break;
+    } while (true);
+    INFO("The replay is over.");
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cout << "Usage:DedicatedServer map players [speed] [seed|-] [replay|-] [profile]" << std::endl;
+        std::cout << "      DedicatedServer -play replay [speed] [from(s)]" << std::endl;
+        return 0;
+    }
+
+    Logger::set(Logger::LEVEL_ERROR, logCallback);
+    Logger::set(Logger::LEVEL_INFO, logCallback);
+    Logger::set(Logger::LEVEL_WARN, logCallback);
+
+    std::string map = argv[1];
+    auto speed = argc > 3 ? std::stof(argv[3]) : 1.0f;
+
+    mountPaks();
+    UnitController::initAllController();
+    loadAllUnits();
+    loadAllBullets();
+
+    if (map == "-play")
+        return play(argv[2], speed, argc > 4 ? std::stoul(argv[4]) * 1000 : 0);
+
+    size_t players = std::stoul(argv[2]);
+    //a seed makes every match deterministic.
+    auto seeded = argc > 4 && argv[4] != "-"s;
+    auto seed = seeded ? std::stoull(argv[4]) : 0ULL;
+    //every match is recorded to its own file.
+    std::string replay = argc > 5 && argv[5] != "-"s ? argv[5] : "";
+    //the timings of the last ticks of every match are dumped as csv and chrome trace.
+    std::string profile = argc > 6 ? argv[6] : "";
+    uint32_t match = 0;
+
+    while (true) {
+        localServer = std::make_unique<Server>(map);
+        INFO("Waiting for ", players, " players.(IP=", localServer->getIP(), ")");
+        while (!ready(localServer->getClientInfo(), players)) {
+            localServer->waitClient();
+            std::this_thread::sleep_for(10ms);
+        }
+        localServer->changeSpeed(speed);
+        if (seeded)
+            localServer->setSeed(seed);
+        if (replay.size()) {
+            localServer->record(replay + std::to_string(match) + ".replay");
+            //a seeded match can be reproduced from its commands.
+            if (seeded && !localServer->logCommands(replay + std::to_string(match) + ".commands"))
+                INFO("Failed to log the commands.");
+        }
+        localServer->run();
+        INFO("The game begins.");
+        while (localServer->isRunning())
+            std::this_thread::sleep_for(100ms);
+        if (profile.size() && !localServer->dumpProfile(profile + std::to_string(match)))
+            INFO("Failed to dump the profile.");
+        localServer.reset();
+        INFO("The game is over.");
+        ++match;
+    }
+}
@@ -89,6 +89,7 @@ static bool androidFileExists(const char* filePath)
 static std::string __resourcePath("./");
 static std::string __assetPath("");
 static std::map<std::string, std::string> __aliases;
+static FileSystem::Provider* __provider = NULL;
 
 /**
  * Gets the fully resolved path.
@@ -100,7 +101,12 @@ static std::map<std::string, std::string> __aliases;
  */
 static void getFullPath(const char* path, std::string& fullPath)
 {
+#ifdef TFL_HEADLESS
+    // The game names its assets "/res/...", they are relative to the resource path like on Windows.
+    if (FileSystem::isAbsolutePath(path) && strncmp(path, "/res/", 5) != 0)
+#else
     if (FileSystem::isAbsolutePath(path))
+#endif
     {
         fullPath.assign(path);
     }
@@ -191,6 +197,11 @@ FileSystem::~FileSystem()
 {
 }
 
+void FileSystem::setProvider(Provider* provider)
+{
+    __provider = provider;
+}
+
 void FileSystem::setResourcePath(const char* path)
 {
     __resourcePath = path == NULL ? "" : path;
@@ -248,7 +259,7 @@ const char* FileSystem::resolvePath(const char* path)
     return path;
 }
 
-bool FileSystem::listFiles(const char* dirPath, std::vector<std::string>& files)
+static bool listDiskFiles(const char* dirPath, std::vector<std::string>& files)
 {
 #ifdef WIN32
     std::string path(FileSystem::getResourcePath());
@@ -344,6 +355,11 @@ bool FileSystem::fileExists(const char* filePath)
 {
     GP_ASSERT(filePath);
 
+    if (__provider && __provider->fileExists(resolvePath(filePath)))
+    {
+        return true;
+    }
+
     std::string fullPath;
 
 #ifdef __ANDROID__
@@ -368,6 +384,12 @@ Stream* FileSystem::open(const char* path, size_t streamMode)
     char modeStr[] = "rb";
     if ((streamMode & WRITE) != 0)
         modeStr[0] = 'w';
+    else if (__provider)
+    {
+        Stream* stream = __provider->open(resolvePath(path));
+        if (stream)
+            return stream;
+    }
 #ifdef __ANDROID__
     std::string fullPath(__resourcePath);
     fullPath += resolvePath(path);
@@ -409,6 +431,21 @@ Stream* FileSystem::open(const char* path, size_t streamMode)
 #endif
 }
 
+bool FileSystem::listFiles(const char* dirPath, std::vector<std::string>& files)
+{
+    bool provided = __provider && __provider->listFiles(dirPath, files);
+    size_t count = files.size();
+    bool result = listDiskFiles(dirPath, files);
+    if (provided && result)
+    {
+        // Drop the files on disk that the provider has already listed.
+        std::vector<std::string>::iterator end = files.begin() + count;
+        files.erase(std::remove_if(files.begin() + count, files.end(),
+            [&](const std::string& name) { return std::find(files.begin(), end, name) != end; }), files.end());
+    }
+    return provided || result;
+}
+
 FILE* FileSystem::openFile(const char* filePath, const char* mode)
 {
     GP_ASSERT(filePath);
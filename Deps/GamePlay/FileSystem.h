@@ -3,6 +3,7 @@
 
 #include "Stream.h"
 #include <string>
+#include <vector>
 
 namespace gameplay
 {
@@ -38,11 +39,51 @@ public:
         SAVE 
     };
 
+    /**
+     * Serves read-only files before the device file system is searched, e.g. from an archive.
+     *
+     * The paths passed to a provider are resolved and relative to the resource path.
+     *
+     * @script{ignore}
+     */
+    class Provider
+    {
+    public:
+
+        virtual ~Provider() {}
+
+        /**
+         * Opens a read-only stream, or returns NULL when the provider does not have the file.
+         */
+        virtual Stream* open(const char* path) = 0;
+
+        /**
+         * Checks if the provider has the file.
+         */
+        virtual bool fileExists(const char* path) = 0;
+
+        /**
+         * Appends the files directly in the directory to the vector.
+         *
+         * @return True if the provider knows the directory.
+         */
+        virtual bool listFiles(const char* dirPath, std::vector<std::string>& files) = 0;
+    };
+
     /**
      * Destructor.
      */
     ~FileSystem();
 
+    /**
+     * Sets the provider searched before the device file system. It is not owned.
+     *
+     * @param provider The provider, or NULL to remove it.
+     *
+     * @script{ignore}
+     */
+    static void setProvider(Provider* provider);
+
     /**
      * Sets the path to the root of the resources folder for the game.
      *
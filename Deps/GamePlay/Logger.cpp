@@ -62,11 +62,13 @@ void Logger::log(Level level, const char* message, ...)
         // Pass call to registered C log function
         (*state.logFunctionC)(level, str);
     }
+#ifndef TFL_HEADLESS
     else if (state.logFunctionLua)
     {
         // Pass call to registered Lua log function
         Game::getInstance()->getScriptController()->executeFunction<void>(state.logFunctionLua, "[Logger::Level]s", NULL, level, str);
     }
+#endif
     else
     {
         // Log to the default output
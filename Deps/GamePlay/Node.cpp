@@ -40,8 +40,10 @@ Node::~Node()
     removeAllChildren();
     if (_drawable)
         _drawable->setNode(NULL);
+#ifndef TFL_HEADLESS
     if (_audioSource)
         _audioSource->setNode(NULL);
+#endif
     Ref* ref = dynamic_cast<Ref*>(_drawable);
     SAFE_RELEASE(ref);
     SAFE_RELEASE(_camera);
@@ -227,6 +229,7 @@ Node* Node::findNode(const char* id, bool recursive, bool exactMatch, bool skipS
 {
     GP_ASSERT(id);
 
+#ifndef TFL_HEADLESS
     // If not skipSkin hierarchy, try searching the skin hierarchy
     if (!skipSkin)
     {
@@ -248,6 +251,7 @@ Node* Node::findNode(const char* id, bool recursive, bool exactMatch, bool skipS
             }
         }
     }
+#endif
     // Search immediate children first.
     for (Node* child = getFirstChild(); child != NULL; child = child->getNextSibling())
     {
@@ -284,6 +288,7 @@ unsigned int Node::findNodes(const char* id, std::vector<Node*>& nodes, bool rec
     // If the drawable is a model with a mesh skin, search the skin's hierarchy as well.
     unsigned int count = 0;
 
+#ifndef TFL_HEADLESS
     if (!skipSkin)
     {
         Node* rootNode = NULL;
@@ -301,6 +306,7 @@ unsigned int Node::findNodes(const char* id, std::vector<Node*>& nodes, bool rec
             }
         }
     }
+#endif
 
     // Search immediate children first.
     for (Node* child = getFirstChild(); child != NULL; child = child->getNextSibling())
@@ -387,10 +393,12 @@ void Node::setEnabled(bool enabled)
 {
     if (_enabled != enabled)
     {
+#ifndef TFL_HEADLESS
         if (_collisionObject)
         {
             _collisionObject->setEnabled(enabled);
         }
+#endif
         _enabled = enabled;
     }
 }
@@ -431,7 +439,11 @@ void Node::update(float elapsedTime)
 
 bool Node::isStatic() const
 {
+#ifdef TFL_HEADLESS
+    return false;
+#else
     return (_collisionObject && _collisionObject->isStatic());
+#endif
 }
 
 const Matrix& Node::getWorldMatrix() const
@@ -447,7 +459,11 @@ const Matrix& Node::getWorldMatrix() const
             // If we have a parent, multiply our parent world transform by our local
             // transform to obtain our final resolved world transform.
             Node* parent = getParent();
+#ifdef TFL_HEADLESS
+            if (parent)
+#else
             if (parent && (!_collisionObject || _collisionObject->isKinematic()))
+#endif
             {
                 Matrix::multiply(parent->getWorldMatrix(), getMatrix(), &_world);
             }
@@ -1004,6 +1020,7 @@ void Node::cloneInto(Node* node, NodeCloneContext& context) const
         if (ref)
             ref->release();
     }
+#ifndef TFL_HEADLESS
     if (AudioSource* audio = getAudioSource())
     {
         AudioSource* clone = audio->clone(context);
@@ -1012,6 +1029,7 @@ void Node::cloneInto(Node* node, NodeCloneContext& context) const
         if (ref)
             ref->release();
     }
+#endif
     if (_tags)
     {
         node->_tags = new std::map<std::string, std::string>(_tags->begin(), _tags->end());
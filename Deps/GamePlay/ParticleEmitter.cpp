@@ -286,6 +286,13 @@ bool ParticleEmitter::isStarted() const
     return _started;
 }
 
+void ParticleEmitter::reset()
+{
+    _started = false;
+    _particleCount = 0;
+    _emitTime = 0;
+}
+
 bool ParticleEmitter::isActive() const
 {
     if (_started)
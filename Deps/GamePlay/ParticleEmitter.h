@@ -265,6 +265,11 @@ public:
      */
     bool isStarted() const;
 
+    /**
+     * Stops emitting particles and kills all of the particles alive, so the emitter can be reused.
+     */
+    void reset();
+
     /**
      * Gets whether this ParticleEmitter is currently active (i.e. if any of its particles are alive).
      * 
@@ -71,11 +71,13 @@ Scene::~Scene()
     // Unbind our active camera from the audio listener
     if (_activeCamera)
     {
+#ifndef TFL_HEADLESS
         AudioListener* audioListener = AudioListener::getInstance();
         if (audioListener && (audioListener->getCamera() == _activeCamera))
         {
             audioListener->setCamera(NULL);
         }
+#endif
 
         SAFE_RELEASE(_activeCamera);
     }
@@ -336,15 +338,19 @@ void Scene::setActiveCamera(Camera* camera)
     // Make sure we don't release the camera if the same camera is set twice.
     if (_activeCamera != camera)
     {
+#ifndef TFL_HEADLESS
         AudioListener* audioListener = AudioListener::getInstance();
+#endif
 
         if (_activeCamera)
         {
+#ifndef TFL_HEADLESS
             // Unbind the active camera from the audio listener
             if (audioListener && (audioListener->getCamera() == _activeCamera))
             {
                 audioListener->setCamera(NULL);
             }
+#endif
 
             SAFE_RELEASE(_activeCamera);
         }
@@ -355,10 +361,12 @@ void Scene::setActiveCamera(Camera* camera)
         {
             _activeCamera->addRef();
 
+#ifndef TFL_HEADLESS
             if (audioListener && _bindAudioListenerToCamera)
             {
                 audioListener->setCamera(_activeCamera);
             }
+#endif
         }
     }
 }
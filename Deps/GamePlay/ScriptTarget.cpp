@@ -426,6 +426,7 @@ template<> void ScriptTarget::fireScriptEvent<void>(const Event* event, ...)
 
     // Lookup registered callbacks for this event and fire them
     std::map<const Event*, std::vector<CallbackFunction>>::iterator itr = _scriptCallbacks->find(event);
+#ifndef TFL_HEADLESS
     if (itr != _scriptCallbacks->end())
     {
         ScriptController* sc = Game::getInstance()->getScriptController();
@@ -436,6 +437,7 @@ template<> void ScriptTarget::fireScriptEvent<void>(const Event* event, ...)
             sc->executeFunction<void>(cb.script, cb.function.c_str(), event->args.c_str(), NULL, &list);
         }
     }
+#endif
 
     va_end(list);
 }
@@ -452,6 +454,7 @@ template<> bool ScriptTarget::fireScriptEvent<bool>(const Event* event, ...)
 
     // Lookup registered callbacks for this event and fire them
     std::map<const Event*, std::vector<CallbackFunction>>::iterator itr = _scriptCallbacks->find(event);
+#ifndef TFL_HEADLESS
     if (itr != _scriptCallbacks->end())
     {
         ScriptController* sc = Game::getInstance()->getScriptController();
@@ -468,6 +471,7 @@ template<> bool ScriptTarget::fireScriptEvent<bool>(const Event* event, ...)
             }
         }
     }
+#endif
 
     va_end(list);
 
@@ -2,41 +2,107 @@
 #include <iostream>
 #include <fstream>
 #include <set>
+#include <vector>
+#include <algorithm>
+#include <cctype>
 #include<random>
+#include <zlib.h>
 using namespace std;
 using namespace std::experimental::filesystem;
 ofstream out;
-struct Path {
+//must match PakCodec and PakEntry in Core/Pak.h.
+enum class Codec : uint32_t { store, deflate };
+struct Entry {
+    uint64_t hash = 0;
+    uint64_t offset = 0;
+    uint64_t contentHash = 0;
+    uint32_t size = 0;
+    uint32_t packedSize = 0;
+    Codec codec = Codec::store;
     char name[60] = {};
-    uint32_t size=0;
 };
+static_assert(sizeof(Entry) == 96, "");
+constexpr uint32_t magic = 0x324B5054;//TPK2
+constexpr uint32_t blockSize = 1U << 16;
+struct File {
+    Entry entry;
+    vector<char> data;
+};
+vector<File> files;
+uint64_t hashData(const char* data, size_t size) {
+    uint64_t res = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+        res ^= static_cast<unsigned char>(data[i]);
+        res *= 1099511628211ULL;
+    }
+    return res;
+}
 const std::set<path> exts =
 { ".config", ".form",".gpb",".theme",".png",
 ".data",".info",".terrain",".material",".frag",
 ".vert",".ogg",".scene",".physics"};
+//these are compressed already.
+const std::set<path> stored = { ".png",".ogg" };
+//every block is compressed alone,so the game can unpack them on all the cores.
+bool pack(File& info) {
+    auto&& src = info.data;
+    uint32_t num = (src.size() + blockSize - 1) / blockSize;
+    vector<uint32_t> sizes(num);
+    vector<char> blocks;
+    for (uint32_t i = 0; i < num; ++i) {
+        uLong size = min<size_t>(blockSize, src.size() - i*blockSize);
+        uLongf packed = compressBound(size);
+        auto pos = blocks.size();
+        blocks.resize(pos + packed);
+        if (compress2(reinterpret_cast<Bytef*>(blocks.data() + pos), &packed,
+            reinterpret_cast<const Bytef*>(src.data() + i*blockSize), size, Z_BEST_COMPRESSION) != Z_OK)
+            return false;
+        blocks.resize(pos + packed);
+        sizes[i] = packed;
+    }
+    auto total = num*sizeof(uint32_t) + blocks.size();
+    if (total >= src.size())return false;
+    vector<char> res(reinterpret_cast<const char*>(sizes.data()),
+        reinterpret_cast<const char*>(sizes.data() + num));
+    res.insert(res.end(), blocks.begin(), blocks.end());
+    info.data.swap(res);
+    info.entry.codec = Codec::deflate;
+    return true;
+}
 void find(const path& p) {
     for (auto&& child : directory_iterator(p)) {
         cout << child.path();
         if (child.status().type() == file_type::regular 
             && exts.find(child.path().extension())!=exts.cend()) {
-            Path info;
+            File info;
             auto abs = child.path().string();
             for (auto& i : abs)
                 if (i == '\\')
                     i = '/';
-            strcpy(info.name,abs.c_str());
-            info.size = file_size(child.path());
-            out.write(reinterpret_cast<const char*>(&info), sizeof(info));
-            if (info.size) {
+            if (abs.size() >= sizeof(info.entry.name)) {
+                cout << "Error: The path is too long." << endl;
+                throw;
+            }
+            strcpy(info.entry.name,abs.c_str());
+            //the game hashes the lower case path,the name keeps the case for listing.
+            for (auto& i : abs)
+                i = static_cast<char>(tolower(static_cast<unsigned char>(i)));
+            info.entry.hash = hashData(abs.c_str(), abs.size());
+            info.entry.size = file_size(child.path());
+            info.data.resize(info.entry.size);
+            if (info.entry.size) {
                 ifstream in(child.path(), ios::binary);
-                if (in.is_open())
-                    out << in.rdbuf();
-                else {
+                if (!in.read(info.data.data(), info.data.size())) {
                     cout << "Error: Cannot open the file." << endl;
                     throw;
                 }
             }
-            cout << " size:"<< info.size;
+            info.entry.contentHash = hashData(info.data.data(), info.data.size());
+            if (stored.find(child.path().extension()) != stored.cend() || !pack(info))
+                info.entry.codec = Codec::store;
+            info.entry.packedSize = info.data.size();
+            cout << " size:"<< info.entry.size << " packed:" << info.entry.packedSize;
+            files.emplace_back(move(info));
         }
         else cout << "   ignored";
         cout << endl;
@@ -61,6 +127,19 @@ int main(int argc,char** argv) {
         out.write(depName, 32);
     }
     find(argv[1]);
+    //the table of contents is sorted by hash,the game looks the files up with a binary search.
+    sort(files.begin(), files.end(), [](const File& a, const File& b) {return a.entry.hash < b.entry.hash; });
+    uint32_t count = files.size();
+    out.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    uint64_t offset = static_cast<uint64_t>(out.tellp()) + count * sizeof(Entry);
+    for (auto&& f : files) {
+        f.entry.offset = offset;
+        offset += f.entry.packedSize;
+        out.write(reinterpret_cast<const char*>(&f.entry), sizeof(f.entry));
+    }
+    for (auto&& f : files)
+        out.write(f.data.data(), f.data.size());
     out.close();
     cin.get();
     cin.get();
@@ -13,8 +13,11 @@
 #undef max
 #undef min
 #include "../Core/common.cpp"
+#include "../Core/Pak.cpp"
+#include "../Core/ThreadPool.cpp"
 using namespace gameplay;
 #include "../Core/Message.h"
+#include "../Core/Snapshot.cpp"
 using namespace std::literals;
 
 class AI final {
@@ -353,10 +356,11 @@ p2:
 
     bool isStop = false;
     std::set<uint32_t> old;
+    SnapshotDecoder decoder;
 
     auto begin = std::chrono::system_clock::now();
     while (true) {
-        std::vector<unsigned char> latestData;
+        const Snapshot* latest = nullptr;
         FORNET{
             if (isStop)continue;
             RakNet::BitStream data(packet->data, packet->length, false);
@@ -377,25 +381,26 @@ p2:
                 isStop = true;
                 continue;
             }
-            CheckHeader(ServerMessage::updateUnit) {
-                latestData = std::vector<unsigned char>(packet->data, packet->data + packet->length);
+            CheckHeader(ServerMessage::snapshot) {
+                uint32_t time, seq;
+                const Snapshot* snapshot;
+                if (!decoder.readMessage(data, time, seq, snapshot))continue;
+                latest = snapshot;
+                RakNet::BitStream ack;
+                ack.Write(ClientMessage::ack);
+                ack.Write(seq);
+                peer.Send(&ack, PacketPriority::HIGH_PRIORITY, PacketReliability::UNRELIABLE, 0, server, false);
             }
         }
             if (isStop ||
                 peer.GetConnectionState(server) != RakNet::ConnectionState::IS_CONNECTED)break;
-        if (latestData.empty())continue;
+        if (latest == nullptr)continue;
 
         uint32_t mine = 0, armies = 0;
         std::set<uint32_t> copy = old;
 
-        RakNet::BitStream latest(latestData.data(), latestData.size(), false);
-        latest.IgnoreBytes(1);
-        uint32_t size;
-        latest.Read(size);
-        for (uint32_t i = 0; i < size; ++i) {
-            UnitSyncInfo u;
-            latest.Read(u);
-            if (u.isDied)continue;
+        for (auto&& u : latest->getUnits()) {
+            if (u.HP <= 0.0f)continue;
             auto iter = copy.find(u.id);
             if (iter == copy.cend()) {
                 old.insert(u.id);